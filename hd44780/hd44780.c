@@ -3,9 +3,15 @@
 // Display_Lib_RPI is licensed under the MIT License
 
 #include <hd44780.h>
+#include <errno.h>
 #include <libi2c.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
 #include <msleep.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
 
 // DDRAM address's used to set cursor position
 #define LCDLineAddressOne       0x80 // Line 1
@@ -22,28 +28,127 @@
 #define LCDCmdDisplayOff        0x08 // Blank the display (without clearing)
 #define LCDCmdClearScreen       0x01 // clear screen command byte
 
+// PCF8574 control bits, the upper nibble carries the data
+#define LCDPinRS                0x01 // register select, 1 for data
+#define LCDPinRW                0x02 // read, the data pins must be high
+#define LCDPinEN                0x04 // enable, latched on the falling edge
+#define LCDPinBacklight         0x08
+
+// every LCD byte is 4 expander bytes : upper nibble with EN high then
+// low, lower nibble with EN high then low, the expander latches each
+// byte in turn so a whole sequence can go in one write
+#define LCDStreamSize           512
+
+typedef struct hd44780_stream
+{
+    int len;
+    uint8_t data[LCDStreamSize];
+
+} HD44780Stream;
+
+static void _hd44780_stream_init(HD44780Stream *stream);
+static void _hd44780_stream_byte(HD44780 *hd44780, HD44780Stream *stream,
+                                 uint8_t value, bool data);
+static bool _hd44780_stream_send(HD44780 *hd44780, HD44780Stream *stream);
+static bool _hd44780_stream_flush(HD44780 *hd44780, HD44780Stream *stream);
+static bool _hd44780_recover(HD44780 *hd44780);
+static uint8_t _hd44780_line_address(HD44780 *hd44780, int line);
+static void _hd44780_stream_line(HD44780 *hd44780, HD44780Stream *stream, int line);
+static void _hd44780_track(HD44780 *hd44780, uint8_t value, bool data);
+static int _hd44780_next_address(int address, bool increment);
+static int _hd44780_cell_address(HD44780 *hd44780, int row, int col);
+static void _hd44780_wait_ready(HD44780 *hd44780, int delay);
+static uint32_t _hd44780_glyph_hash(const uint8_t *charmap);
+static uint8_t _hd44780_visible_slots(HD44780 *hd44780);
+
 static void _hd44780_write_command(HD44780 *hd44780, unsigned char cmd);
 static void _hd44780_write_data(HD44780 *hd44780, unsigned char data);
 
+static bool _hd44780_setup(HD44780 *hd44780, int cols, int rows);
+static void _hd44780_start(HD44780 *hd44780, uint8_t cursor_type);
+
 bool hd44780_init(HD44780 *hd44780, int channel, int addr,
                   int cols, int rows, uint8_t cursor_type)
 {
     hd44780->channel = channel;
     hd44780->addr = addr;
+    hd44780->on_write = NULL;
+    hd44780->user = NULL;
+
+    if (!_hd44780_setup(hd44780, cols, rows))
+        return false;
+
+    hd44780->file = i2c_init(channel, addr);
+
+    if (hd44780->file < 0)
+        return false;
+
+    _hd44780_start(hd44780, cursor_type);
+
+    return true;
+}
+
+/*!
+	@brief  Init with the expander bytes sent to a callback instead of
+	an I2C device, for a simulator
+	@param  on_write  returns the number of bytes written or -1
+	@return false if the size is not supported
+*/
+bool hd44780_init_callback(HD44780 *hd44780, HD44780WriteFunc on_write, void *user,
+                           int cols, int rows, uint8_t cursor_type)
+{
+    hd44780->channel = -1;
+    hd44780->addr = 0;
+    hd44780->file = -1;
+    hd44780->on_write = on_write;
+    hd44780->user = user;
+
+    if (!_hd44780_setup(hd44780, cols, rows))
+        return false;
+
+    _hd44780_start(hd44780, cursor_type);
+
+    return true;
+}
+
+static bool _hd44780_setup(HD44780 *hd44780, int cols, int rows)
+{
     hd44780->cols = cols;
     hd44780->rows = rows;
 
     hd44780->backlight = LCDBackLightOnMask;
 
-    hd44780->_I2C_ErrorDelay = 100;
+    hd44780->_I2C_ErrorDelay = 200;
     hd44780->_I2C_ErrorRetryNum = 3;
     hd44780->_I2C_ErrorFlag = 0;
 
-    hd44780->file = i2c_init(channel, addr);
+    hd44780->busypoll = false;
+    hd44780->busy_timeout = 10000;
 
-    if (hd44780->file < 0)
+    if (cols > HD44780_MAX_COLS || rows > HD44780_MAX_ROWS)
         return false;
 
+    // unknown until the clear command
+    hd44780->ddram_valid = false;
+    hd44780->address = -1;
+    hd44780->cgram = false;
+    hd44780->increment = true;
+    hd44780->autoshift = false;
+    hd44780->shift = 0;
+    hd44780->display = LCDCmdDisplayOn;
+
+    hd44780_frame_clear(hd44780);
+
+    // CGRAM content is unknown
+    memset(hd44780->cg_used, 0, sizeof(hd44780->cg_used));
+    memset(hd44780->cg_stamp, 0, sizeof(hd44780->cg_stamp));
+    hd44780->cg_clock = 0;
+
+    return true;
+}
+
+static void _hd44780_start(HD44780 *hd44780, uint8_t cursor_type)
+{
     msleep(15);
     _hd44780_write_command(hd44780, LCDCmdHomePosition);
     msleep(5);
@@ -56,144 +161,458 @@ bool hd44780_init(HD44780 *hd44780, int channel, int addr,
     _hd44780_write_command(hd44780, cursor_type);
     _hd44780_write_command(hd44780, LCDEntryModeThree);
     _hd44780_write_command(hd44780, LCDCmdClearScreen);
-    msleep(5);
 
-    return true;
+    // busy polling can only be turned on once init is done
+    msleep(5);
 }
 
 void hd44780_close(HD44780 *hd44780)
 {
-    close(hd44780->file);
+    if (hd44780->file >= 0)
+        close(hd44780->file);
+
     hd44780->file = -1;
 }
 
-static void _hd44780_write_command(HD44780 *hd44780, unsigned char cmd)
+static void _hd44780_stream_init(HD44780Stream *stream)
+{
+    stream->len = 0;
+}
+
+static void _hd44780_stream_byte(HD44780 *hd44780, HD44780Stream *stream,
+                                 uint8_t value, bool data)
 {
-    // I2C MASK Byte = COMD-led-en-rw-rs (en=enable rs = reg select) (rw always write)
+    // I2C MASK Byte = DATA-led-en-rw-rs (en=enable rs = reg select) (rw always write)
 
-    const uint8_t LCDCmdByteOn = 0x0C;  // enable=1 and rs =0 1100 COMD-led-en-rw-rs
-    const uint8_t LCDCmdByteOff = 0x08; // enable=0 and rs =0 1000 COMD-led-en-rw-rs
+    if (stream->len + 4 > LCDStreamSize)
+        _hd44780_stream_send(hd44780, stream);
 
-    unsigned char nibble_upper = cmd & 0xf0;        // select upper nibble
-    unsigned char nibble_lower = (cmd << 4) & 0xf0; // select lower nibble
+    uint8_t ctrl = (LCDPinEN | LCDPinBacklight | (data ? LCDPinRS : 0)) & hd44780->backlight;
 
-    char buffer[4];
+    uint8_t nibble_upper = value & 0xf0;        // select upper nibble
+    uint8_t nibble_lower = (value << 4) & 0xf0; // select lower nibble
 
-    buffer[0] = nibble_upper | (LCDCmdByteOn  & hd44780->backlight); // YYYY-1100 YYYY-led-en-rw-rs ,enable=1 and rs =0
-    buffer[1] = nibble_upper | (LCDCmdByteOff & hd44780->backlight); // YYYY-1000 YYYY-led-en-rw-rs ,enable=0 and rs =0
-    buffer[2] = nibble_lower | (LCDCmdByteOn  & hd44780->backlight); // YYYY-1100 YYYY-led-en-rw-rs ,enable=1 and rs =0
-    buffer[3] = nibble_lower | (LCDCmdByteOff & hd44780->backlight); // YYYY-1000 YYYY-led-en-rw-rs ,enable=0 and rs =0
+    uint8_t *buffer = &stream->data[stream->len];
 
-    /*ssize_t ErrorCode =*/ hd44780_write(hd44780, buffer, 4);
+    _hd44780_track(hd44780, value, data);
 
-    // Error handling retransmit
-    // uint8_t AttemptCount = hd44780->_I2C_ErrorRetryNum;
-    // while (ErrorCode < 0)
-    // {
-    //     if (rdlib_config::isDebugEnabled())
-    //     {
-    //         fprintf(stderr, "Error:  _hd44780_write_command I2C: (%s) \n", lguErrorText(ErrorCode) );
-    //         fprintf(stderr, "Attempt Count: %u \n", AttemptCount );
-    //     }
-    //     msleep(_I2C_ErrorDelay );
-    //     ErrorCode = hd44780_write (hd44780, cmdBufferI2C, 4); // retransmit
-    //     _I2C_ErrorFlag = ErrorCode;
-    //     AttemptCount--;
-    //     if (AttemptCount == 0) break;
-    // }
+    buffer[0] = nibble_upper | ctrl;                // YYYY-1X0X enable=1
+    buffer[1] = nibble_upper | (ctrl & ~LCDPinEN);  // YYYY-10XX enable=0
+    buffer[2] = nibble_lower | ctrl;
+    buffer[3] = nibble_lower | (ctrl & ~LCDPinEN);
 
-    //_I2C_ErrorFlag = ErrorCode;
+    stream->len += 4;
 }
 
-static void _hd44780_write_data(HD44780 *hd44780, unsigned char data)
+static bool _hd44780_write_retry(HD44780 *hd44780, const uint8_t *data, int len)
 {
-    // I2C MASK Byte = DATA-led-en-rw-rs (en=enable rs = reg select)(rw always write)
-    const uint8_t LCDDataByteOn = 0x0D;   // enable=1 and rs =1 1101 DATA-led-en-rw-rs
-    const  uint8_t LCDDataByteOff = 0x09; // enable=0 and rs =1 1001 DATA-led-en-rw-rs
+    // retry failed writes with a doubling delay, a short write is not
+    // retried since part of the nibbles were latched
 
-    char buffer[4];
+    uint32_t delay = hd44780->_I2C_ErrorDelay;
 
-    unsigned char nibble_upper = data & 0xf0;
+    for (int attempt = 0; ; ++attempt)
+    {
+        ssize_t ret = hd44780_write(hd44780, data, len);
 
-    // enable=1 and rs =1 1101  YYYY-X-en-X-rs
-    buffer[0] = nibble_upper | (LCDDataByteOn  & hd44780->backlight);
+        if (ret == len)
+            return true;
 
-    // enable=0 and rs =1 1001 YYYY-X-en-X-rs
-    buffer[1] = nibble_upper | (LCDDataByteOff & hd44780->backlight);
+        hd44780->_I2C_ErrorFlag = (ret < 0) ? -errno : -EIO;
 
-    unsigned char nibble_lower = (data << 4) & 0xf0;
+        if (ret > 0 || attempt >= hd44780->_I2C_ErrorRetryNum)
+            return false;
 
-    // enable=1 and rs =1 1101  YYYY-X-en-X-rs
-    buffer[2] = nibble_lower | (LCDDataByteOn  & hd44780->backlight);
+        usleep(delay);
+        delay *= 2;
+    }
+}
 
-    // enable=0 and rs =1 1001 YYYY-X-en-X-rs
-    buffer[3] = nibble_lower | (LCDDataByteOff & hd44780->backlight);
+static bool _hd44780_stream_flush(HD44780 *hd44780, HD44780Stream *stream)
+{
+    if (stream->len == 0)
+        return true;
+
+    bool result = _hd44780_write_retry(hd44780, stream->data, stream->len);
 
-    /*int ErrorCode =*/ hd44780_write(hd44780, buffer, 4);
+    stream->len = 0;
 
-    // Error handling retransmit
-    // uint8_t AttemptCount = hd44780->_I2C_ErrorRetryNum;
-    // while (ErrorCode < 0)
-    // {
-    //         if (rdlib_config::isDebugEnabled())
-    //         {
-    //                 fprintf(stderr, "Error:  LCDSendData I2C: (%s) \n", lguErrorText(ErrorCode) );
-    //                 fprintf(stderr, "Attempt Count: %u \n", AttemptCount );
-    //         }
-    //         msleep(_I2C_ErrorDelay );
-    //         ErrorCode = hd44780_write (hd44780, dataBufferI2C, 4); // retransmit
-    //         _I2C_ErrorFlag = ErrorCode;
-    //         AttemptCount--;
-    //         if (AttemptCount == 0) break;
-    // }
-    // _I2C_ErrorFlag = ErrorCode;
+    return result;
 }
 
-void hd44780_clear_line(HD44780 *hd44780, int line)
+static bool _hd44780_stream_send(HD44780 *hd44780, HD44780Stream *stream)
 {
-    // clear a line by writing spaces to every position
+    if (_hd44780_stream_flush(hd44780, stream))
+        return true;
 
-    switch (line)
+    // the shadow was updated when the bytes were queued, so it holds
+    // what should be on the display
+    fprintf(stderr, "Error: LCD write failed, resynchronizing\n");
+
+    return _hd44780_recover(hd44780);
+}
+
+static bool _hd44780_stream_nibble(HD44780 *hd44780, uint8_t nibble)
+{
+    // a single command nibble, as the 8-bit interface expects it
+
+    uint8_t ctrl = (LCDPinEN | LCDPinBacklight) & hd44780->backlight;
+    uint8_t data[2] = {(nibble << 4) | ctrl, (nibble << 4) | (ctrl & ~LCDPinEN)};
+
+    return _hd44780_write_retry(hd44780, data, 2);
+}
+
+static bool _hd44780_recover(HD44780 *hd44780)
+{
+    // Put the interface back in 4-bit mode whatever nibble it expects
+    // next, 0x3 three times selects the 8-bit mode then 0x2 the 4-bit
+    // mode, then replay the shadow : DDRAM, CGRAM, entry mode, display
+    // shift and address counter.
+
+    uint8_t ddram[HD44780_DDRAM_SIZE];
+    memcpy(ddram, hd44780->ddram, HD44780_DDRAM_SIZE);
+
+    bool valid = hd44780->ddram_valid;
+    int address = hd44780->address;
+    bool cgram = hd44780->cgram;
+    uint8_t entry = LCDEntryModeOne | (hd44780->increment ? 0x02 : 0)
+                    | (hd44780->autoshift ? 0x01 : 0);
+    int shift = hd44780->shift;
+
+    // unknown until the replay succeeds
+    hd44780->ddram_valid = false;
+    hd44780->address = -1;
+
+    if (!_hd44780_stream_nibble(hd44780, 0x03))
+        return false;
+    usleep(4100);
+    if (!_hd44780_stream_nibble(hd44780, 0x03))
+        return false;
+    usleep(100);
+    if (!_hd44780_stream_nibble(hd44780, 0x03)
+        || !_hd44780_stream_nibble(hd44780, 0x02))
+        return false;
+
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    _hd44780_stream_byte(hd44780, &stream, LCDCmdModeFourBit, false);
+    _hd44780_stream_byte(hd44780, &stream, hd44780->display, false);
+    _hd44780_stream_byte(hd44780, &stream, LCDEntryModeThree, false);
+
+    if (valid)
+        _hd44780_stream_byte(hd44780, &stream, LCDCmdClearScreen, false);
+
+    if (!_hd44780_stream_flush(hd44780, &stream))
+        return false;
+
+    if (valid)
+        _hd44780_wait_ready(hd44780, 2);
+
+    for (int slot = 0; slot < HD44780_CGRAM_SLOTS; ++slot)
     {
-        case LCDLineNumberOne:
-            _hd44780_write_command(hd44780, LCDLineAddressOne);
-            break;
+        if (!hd44780->cg_used[slot])
+            continue;
 
-        case LCDLineNumberTwo:
-            _hd44780_write_command(hd44780, LCDLineAddressTwo);
-            break;
+        _hd44780_stream_byte(hd44780, &stream, 0x40 | (slot << 3), false);
 
-        case LCDLineNumberThree:
-            switch (hd44780->cols)
-            {
-                case 16:
-                    _hd44780_write_command(hd44780, LCDLineAddress3Col16);
-                    break;
+        for (int i = 0; i < 8; ++i)
+            _hd44780_stream_byte(hd44780, &stream, hd44780->cg_glyph[slot][i], true);
+    }
 
-                case 20:
-                    _hd44780_write_command(hd44780, LCDLineAddress3Col20);
-                    break;
-            }
-            break;
+    if (!_hd44780_stream_flush(hd44780, &stream))
+    {
+        memset(hd44780->cg_used, 0, sizeof(hd44780->cg_used));
+        return false;
+    }
 
-        case LCDLineNumberFour:
-            switch (hd44780->cols)
-            {
-                case 16:
-                _hd44780_write_command(hd44780, LCDLineAddress4Col16);
-                    break;
+    if (valid)
+    {
+        // each DDRAM line in its own write, 41 bytes
+        for (int line = 0x00; line <= 0x40; line += 0x40)
+        {
+            _hd44780_stream_byte(hd44780, &stream, 0x80 | line, false);
 
-                case 20:
-                    _hd44780_write_command(hd44780, LCDLineAddress4Col20);
-                    break;
-            }
-            break;
+            for (int i = 0; i < HD44780_DDRAM_LINE; ++i)
+                _hd44780_stream_byte(hd44780, &stream, ddram[line + i], true);
+
+            if (!_hd44780_stream_flush(hd44780, &stream))
+                return false;
+        }
     }
 
+    _hd44780_stream_byte(hd44780, &stream, entry, false);
+
+    for (int i = 0; valid && i < shift; ++i)
+        _hd44780_stream_byte(hd44780, &stream, 0x18, false);
+
+    if (cgram)
+        _hd44780_stream_byte(hd44780, &stream, 0x40, false);
+    else if (address >= 0)
+        _hd44780_stream_byte(hd44780, &stream, 0x80 | address, false);
+
+    if (!_hd44780_stream_flush(hd44780, &stream))
+        return false;
+
+    hd44780->ddram_valid = valid;
+
+    return true;
+}
+
+static void _hd44780_track(HD44780 *hd44780, uint8_t value, bool data)
+{
+    // follow what a byte does to the controller state
+
+    if (data)
+    {
+        if (hd44780->cgram)
+            return;
+
+        if (hd44780->address >= 0)
+        {
+            hd44780->ddram[hd44780->address] = value;
+            hd44780->address = _hd44780_next_address(hd44780->address,
+                                                     hd44780->increment);
+        }
+
+        if (hd44780->autoshift)
+            hd44780->shift += hd44780->increment ? 1 : -1;
+    }
+    else if (value & 0x80) // set DDRAM address
+    {
+        hd44780->address = value & 0x7f;
+        hd44780->cgram = false;
+    }
+    else if (value & 0x40) // set CGRAM address, the DDRAM address is lost
+    {
+        hd44780->address = -1;
+        hd44780->cgram = true;
+    }
+    else if (value & 0x20) // function set
+    {
+    }
+    else if (value & 0x10) // cursor or display shift
+    {
+        bool right = value & 0x04;
+
+        if (value & 0x08)
+            hd44780->shift += right ? -1 : 1;
+        else if (hd44780->address >= 0 && !hd44780->cgram)
+            hd44780->address = _hd44780_next_address(hd44780->address, right);
+    }
+    else if (value & 0x08) // display control
+    {
+        hd44780->display = value;
+    }
+    else if (value & 0x04) // entry mode
+    {
+        hd44780->increment = value & 0x02;
+        hd44780->autoshift = value & 0x01;
+    }
+    else if (value & 0x02) // home
+    {
+        hd44780->address = 0;
+        hd44780->cgram = false;
+        hd44780->shift = 0;
+    }
+    else if (value & 0x01) // clear
+    {
+        memset(hd44780->ddram, ' ', HD44780_DDRAM_SIZE);
+        hd44780->ddram_valid = true;
+        hd44780->address = 0;
+        hd44780->cgram = false;
+        hd44780->increment = true;
+        hd44780->shift = 0;
+    }
+
+    hd44780->shift = (hd44780->shift + 40) % 40;
+}
+
+static int _hd44780_next_address(int address, bool increment)
+{
+    // two line mode, lines are 0x00-0x27 and 0x40-0x67
+
+    if (increment)
+    {
+        if (address == 0x27)
+            return 0x40;
+
+        if (address == 0x67)
+            return 0x00;
+
+        return address + 1;
+    }
+
+    if (address == 0x00)
+        return 0x67;
+
+    if (address == 0x40)
+        return 0x27;
+
+    return address - 1;
+}
+
+static int _hd44780_cell_address(HD44780 *hd44780, int row, int col)
+{
+    // DDRAM address shown at a visible cell, lines are 40 characters
+    // and the display shift moves the window over them
+
+    int address = (_hd44780_line_address(hd44780, row + 1) & 0x7f) + col;
+
+    int line = address & 0x40;
+    int offset = ((address & 0x3f) + hd44780->shift) % 40;
+
+    return line | offset;
+}
+
+static uint8_t _hd44780_line_address(HD44780 *hd44780, int line)
+{
+    // DDRAM address command of the first column of a line, 0 if invalid
+
+    switch (line)
+    {
+    case LCDLineNumberOne:
+        return LCDLineAddressOne;
+
+    case LCDLineNumberTwo:
+        return LCDLineAddressTwo;
+
+    case LCDLineNumberThree:
+        switch (hd44780->cols)
+        {
+        case 16:
+            return LCDLineAddress3Col16;
+        case 20:
+            return LCDLineAddress3Col20;
+        }
+        break;
+
+    case LCDLineNumberFour:
+        switch (hd44780->cols)
+        {
+        case 16:
+            return LCDLineAddress4Col16;
+        case 20:
+            return LCDLineAddress4Col20;
+        }
+        break;
+    }
+
+    return 0;
+}
+
+static void _hd44780_stream_line(HD44780 *hd44780, HD44780Stream *stream, int line)
+{
+    // a line of spaces, starting with the goto
+
+    uint8_t address = _hd44780_line_address(hd44780, line);
+
+    if (address)
+        _hd44780_stream_byte(hd44780, stream, address, false);
+
     for (uint8_t i = 0; i < hd44780->cols; ++i)
+        _hd44780_stream_byte(hd44780, stream, ' ', true);
+}
+
+/*!
+	@brief  Read the busy flag and address counter
+	@details RW high with the data pins released, each nibble is read
+	while EN is high, all in one I2C_RDWR transfer
+	@return BF in bit 7 and the address counter, -1 on error
+*/
+int hd44780_read_status(HD44780 *hd44780)
+{
+    uint8_t bl = hd44780->backlight & LCDPinBacklight;
+    uint8_t high = 0xf0 | bl | LCDPinRW | LCDPinEN;
+    uint8_t low = 0xf0 | bl | LCDPinRW;
+
+    uint8_t upper_on[1] = {high};
+    uint8_t upper_off_lower_on[2] = {low, high};
+    uint8_t lower_off[1] = {low};
+    uint8_t nibbles[2];
+
+    struct i2c_msg msgs[5] =
     {
-        _hd44780_write_data(hd44780, ' ');
+        {hd44780->addr, 0, 1, upper_on},
+        {hd44780->addr, I2C_M_RD, 1, &nibbles[0]},
+        {hd44780->addr, 0, 2, upper_off_lower_on},
+        {hd44780->addr, I2C_M_RD, 1, &nibbles[1]},
+        {hd44780->addr, 0, 1, lower_off},
+    };
+
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = 5;
+
+    if (ioctl(hd44780->file, I2C_RDWR, &rdwr) != 5)
+        return -1;
+
+    return (nibbles[0] & 0xf0) | (nibbles[1] >> 4);
+}
+
+static uint64_t _hd44780_time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void _hd44780_wait_ready(HD44780 *hd44780, int delay)
+{
+    // wait for a slow command, delay in ms is the fixed delay used
+    // without busy flag or if the flag never clears
+
+    if (hd44780->busypoll)
+    {
+        uint64_t start = _hd44780_time_us();
+
+        while (_hd44780_time_us() - start < hd44780->busy_timeout)
+        {
+            int status = hd44780_read_status(hd44780);
+
+            if (status < 0)
+                break;
+
+            if ((status & 0x80) == 0)
+                return;
+        }
+
+        // no answer, the RW line may not be wired
+        fprintf(stderr, "Error: busy flag timeout, using fixed delays\n");
+        hd44780->busypoll = false;
     }
+
+    msleep(delay);
+}
+
+static void _hd44780_write_command(HD44780 *hd44780, unsigned char cmd)
+{
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    _hd44780_stream_byte(hd44780, &stream, cmd, false);
+    _hd44780_stream_send(hd44780, &stream);
+}
+
+static void _hd44780_write_data(HD44780 *hd44780, unsigned char data)
+{
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    _hd44780_stream_byte(hd44780, &stream, data, true);
+    _hd44780_stream_send(hd44780, &stream);
+}
+
+void hd44780_clear_line(HD44780 *hd44780, int line)
+{
+    // clear a line by writing spaces to every position, in one write
+
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    _hd44780_stream_line(hd44780, &stream, line);
+    _hd44780_stream_send(hd44780, &stream);
 }
 
 /*!
@@ -219,18 +638,13 @@ bool hd44780_clear_screen(HD44780 *hd44780)
         return false;
     }
 
-    hd44780_clear_line(hd44780, LCDLineNumberOne);
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
 
-    if (hd44780->rows >= 2)
-        hd44780_clear_line(hd44780, LCDLineNumberTwo);
+    for (int line = LCDLineNumberOne; line <= hd44780->rows; ++line)
+        _hd44780_stream_line(hd44780, &stream, line);
 
-    if (hd44780->rows >= 3)
-        hd44780_clear_line(hd44780, LCDLineNumberThree);
-
-    if (hd44780->rows == 4)
-        hd44780_clear_line(hd44780, LCDLineNumberFour);
-
-    return true;
+    return _hd44780_stream_send(hd44780, &stream);
 }
 
 /*!
@@ -245,7 +659,7 @@ void hd44780_LCDResetScreen(HD44780 *hd44780, uint8_t cursor_type)
     _hd44780_write_command(hd44780, LCDCmdClearScreen);
     _hd44780_write_command(hd44780, LCDEntryModeThree);
 
-    msleep(5);
+    _hd44780_wait_ready(hd44780, 5);
 }
 
 void hd44780_LCDDisplayON(HD44780 *hd44780, bool on)
@@ -255,7 +669,7 @@ void hd44780_LCDDisplayON(HD44780 *hd44780, bool on)
     else
         _hd44780_write_command(hd44780, LCDCmdDisplayOff);
 
-    msleep(5);
+    _hd44780_wait_ready(hd44780, 5);
 }
 
 bool hd44780_write_string(HD44780 *hd44780, char *str)
@@ -276,10 +690,13 @@ bool hd44780_write_string(HD44780 *hd44780, char *str)
         return false;
     }
 
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
     while (*str)
-        _hd44780_write_data(hd44780, *str++);
+        _hd44780_stream_byte(hd44780, &stream, *str++, true);
 
-    return true;
+    return _hd44780_stream_send(hd44780, &stream);
 }
 
 void hd44780_write_char(HD44780 *hd44780, char data)
@@ -326,22 +743,27 @@ void hd44780_LCDScroll(HD44780 *hd44780, uint8_t direction, uint8_t ScrollSize)
     //Command Byte Code: Scroll display one character left (all lines)
     const uint8_t LCDScrollLeft = 0x18;
 
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
     switch(direction)
     {
     case LCDMoveRight:
         for (uint8_t i = 0; i < ScrollSize; ++i)
         {
-            _hd44780_write_command(hd44780, LCDScrollRight);
+            _hd44780_stream_byte(hd44780, &stream, LCDScrollRight, false);
         }
         break;
 
     case LCDMoveLeft:
         for (uint8_t i = 0; i < ScrollSize; ++i)
         {
-            _hd44780_write_command(hd44780, LCDScrollLeft);
+            _hd44780_stream_byte(hd44780, &stream, LCDScrollLeft, false);
         }
         break;
     }
+
+    _hd44780_stream_send(hd44780, &stream);
 }
 
 /*!
@@ -351,41 +773,114 @@ void hd44780_LCDScroll(HD44780 *hd44780, uint8_t direction, uint8_t ScrollSize)
 */
 void hd44780_goto(HD44780 *hd44780, uint8_t line, uint8_t col)
 {
+    uint8_t address = _hd44780_line_address(hd44780, line);
 
-    switch (line)
+    if (address)
+        _hd44780_write_command(hd44780, address + col);
+}
+
+static uint32_t _hd44780_glyph_hash(const uint8_t *charmap)
+{
+    // FNV-1a of the 5 pixel rows
+
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < 8; ++i)
     {
-    case LCDLineNumberOne:
-        _hd44780_write_command(hd44780, LCDLineAddressOne| col);
-        break;
+        hash ^= charmap[i] & 0x1f;
+        hash *= 16777619u;
+    }
 
-    case LCDLineNumberTwo:
-        _hd44780_write_command(hd44780, LCDLineAddressTwo | col);
-        break;
+    return hash;
+}
 
-    case LCDLineNumberThree:
-        switch (hd44780->cols)
+static uint8_t _hd44780_visible_slots(HD44780 *hd44780)
+{
+    // slots shown on the display or used by the pending frame,
+    // codes 8-15 are the same slots as 0-7
+
+    uint8_t mask = 0;
+
+    for (int row = 0; row < hd44780->rows; ++row)
+    {
+        if (_hd44780_line_address(hd44780, row + 1) == 0)
+            continue;
+
+        for (int col = 0; col < hd44780->cols; ++col)
         {
-        case 16:
-            _hd44780_write_command(hd44780, LCDLineAddress3Col16 | col);
-            break;
-        case 20:
-            _hd44780_write_command(hd44780, LCDLineAddress3Col20 + col);
-            break;
+            uint8_t code = hd44780->frame[row][col];
+
+            if (code < 16)
+                mask |= 1 << (code & 7);
+
+            if (!hd44780->ddram_valid)
+                continue;
+
+            code = hd44780->ddram[_hd44780_cell_address(hd44780, row, col)];
+
+            if (code < 16)
+                mask |= 1 << (code & 7);
         }
-        break;
+    }
 
-    case LCDLineNumberFour:
-        switch (hd44780->cols)
+    return mask;
+}
+
+/*!
+	@brief  Get a character code showing a custom glyph, uploading it if needed
+	@details A slot already holding the same glyph is reused, otherwise the
+	least recently used slot that is neither on the display nor in the pending
+	frame is replaced.
+	@param charmap An array of 8 bytes representing a custom character data
+	@return the character code 0-7, -1 if every slot is in use on screen
+*/
+int hd44780_custom_char(HD44780 *hd44780, const uint8_t *charmap)
+{
+    if (charmap == NULL)
+        return -1;
+
+    uint32_t hash = _hd44780_glyph_hash(charmap);
+
+    hd44780->cg_clock++;
+
+    int slot = -1;
+
+    for (int i = 0; i < HD44780_CGRAM_SLOTS; ++i)
+    {
+        if (hd44780->cg_used[i] && hd44780->cg_hash[i] == hash
+            && memcmp(hd44780->cg_glyph[i], charmap, 8) == 0)
         {
-        case 16:
-            _hd44780_write_command(hd44780, LCDLineAddress4Col16 | col);
-            break;
-        case 20:
-            _hd44780_write_command(hd44780, LCDLineAddress4Col20 + col);
+            hd44780->cg_stamp[i] = hd44780->cg_clock;
+            return i;
+        }
+    }
+
+    // miss, look for a free slot then the oldest one not in use
+
+    uint8_t visible = _hd44780_visible_slots(hd44780);
+
+    for (int i = 0; i < HD44780_CGRAM_SLOTS; ++i)
+    {
+        if (visible & (1 << i))
+            continue;
+
+        if (!hd44780->cg_used[i])
+        {
+            slot = i;
             break;
         }
-        break;
+
+        if (slot < 0 || hd44780->cg_stamp[i] < hd44780->cg_stamp[slot])
+            slot = i;
     }
+
+    if (slot < 0)
+        return -1;
+
+    if (!hd44780_LCDCreateCustomChar(hd44780, slot, (uint8_t*) charmap))
+        return -1;
+
+    return slot;
 }
 
 /*!
@@ -397,7 +892,7 @@ void hd44780_goto(HD44780 *hd44780, uint8_t line, uint8_t col)
 		-# CharArrayNullptr
 		-# InvalidRAMLocation
 */
-bool  hd44780_LCDCreateCustomChar(HD44780 *hd44780, uint8_t location, uint8_t * charmap)
+bool hd44780_LCDCreateCustomChar(HD44780 *hd44780, uint8_t location, uint8_t * charmap)
 {
     if (charmap == NULL)
     {
@@ -411,17 +906,41 @@ bool  hd44780_LCDCreateCustomChar(HD44780 *hd44780, uint8_t location, uint8_t *
         return false;
     }
 
+    // a slot loaded by hand is recent for the cache too
+    hd44780->cg_stamp[location] = ++hd44780->cg_clock;
+
+    // already there
+    if (hd44780->cg_used[location] && memcmp(hd44780->cg_glyph[location], charmap, 8) == 0)
+        return true;
+
     // character-generator RAM (CG RAM address)
     const uint8_t LCD_CG_RAM = 0x40;
 
-    _hd44780_write_command(hd44780, LCD_CG_RAM | (location<<3));
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    _hd44780_stream_byte(hd44780, &stream, LCD_CG_RAM | (location<<3), false);
 
     for (uint8_t i = 0; i < 8; ++i)
     {
-        _hd44780_write_data(hd44780, charmap[i]);
+        _hd44780_stream_byte(hd44780, &stream, charmap[i], true);
     }
 
-    return true;
+    // kept before sending so a recovery replays it
+    hd44780->cg_used[location] = true;
+    hd44780->cg_hash[location] = _hd44780_glyph_hash(charmap);
+    memcpy(hd44780->cg_glyph[location], charmap, 8);
+
+    bool result = _hd44780_stream_send(hd44780, &stream);
+
+    // unknown after a failed upload
+    if (!result)
+    {
+        hd44780->cg_used[location] = false;
+        hd44780->cg_hash[location] = 0;
+    }
+
+    return result;
 }
 
 /*!
@@ -437,6 +956,19 @@ void hd44780_set_backlight(HD44780 *hd44780, bool on)
         hd44780->backlight = LCDBackLightOffMask;
 }
 
+/*!
+	@brief  Wait on the busy flag instead of fixed delays after slow commands
+	@param on true to poll the busy flag
+	@param timeout_us give up after this time and go back to fixed delays
+	@note the RW pin of the display must be wired to the expander,
+	init resets the setting and always uses the fixed delays
+*/
+void hd44780_set_busypoll(HD44780 *hd44780, bool on, uint16_t timeout_us)
+{
+    hd44780->busypoll = on;
+    hd44780->busy_timeout = timeout_us;
+}
+
 /*!
 	@brief  get the backlight flag status
 	@return the status of backlight on or off , true or false.
@@ -491,7 +1023,7 @@ void hd44780_LCDPrintCustomChar(HD44780 *hd44780, uint8_t location)
 void hd44780_LCDClearScreenCmd(HD44780 *hd44780)
 {
     _hd44780_write_command(hd44780, LCDCmdClearScreen);
-    msleep(3);
+    _hd44780_wait_ready(hd44780, 3);
 }
 
 /*!
@@ -500,7 +1032,7 @@ void hd44780_LCDClearScreenCmd(HD44780 *hd44780)
 void hd44780_LCDHome(HD44780 *hd44780)
 {
     _hd44780_write_command(hd44780, LCDCmdHomePosition);
-    msleep(3);
+    _hd44780_wait_ready(hd44780, 3);
 }
 
 /*!
@@ -510,14 +1042,15 @@ void hd44780_LCDHome(HD44780 *hd44780)
 void hd44780_LCDChangeEntryMode(HD44780 *hd44780, uint8_t newEntryMode)
 {
     _hd44780_write_command(hd44780, newEntryMode);
-    msleep(3);
+    _hd44780_wait_ready(hd44780, 3);
 }
 
 
 /*!
 	@brief get I2C error Flag
-	@details See Error Codes at bottom of https://abyz.me.uk/lg/lgpio.html
-	@return I2C error flag
+	@details Set by a failed write, the display is resynchronized and
+	restored from the shadow when the write can't be retried
+	@return I2C error flag, the last write error as -errno, 0 if none
 */
 int hd44780_LCDI2CErrorGet(HD44780 *hd44780)
 {
@@ -526,8 +1059,9 @@ int hd44780_LCDI2CErrorGet(HD44780 *hd44780)
 
 /*!
 	 @brief Sets the I2C timeout, in the event of an I2C write error
-	 @details Delay between retry attempts in event of an error , mS
-	 @param newTimeout I2C timeout delay in mS
+	 @details Delay before the first retry in event of an error, doubled
+	 at each attempt, uS
+	 @param newTimeout I2C timeout delay in uS
 */
 void hd44780_LCDI2CErrorTimeoutSet(HD44780 *hd44780, uint16_t newTimeout)
 {
@@ -536,8 +1070,8 @@ void hd44780_LCDI2CErrorTimeoutSet(HD44780 *hd44780, uint16_t newTimeout)
 
 /*!
 	 @brief Gets the I2C timeout, used in the event of an I2C write error
-	 @details Delay between retry attempts in event of an error , mS
-	 @return  I2C timeout delay in mS, _I2C_ErrorDelay
+	 @details Delay before the first retry in event of an error, uS
+	 @return  I2C timeout delay in uS, _I2C_ErrorDelay
 */
 uint16_t hd44780_LCDI2CErrorTimeoutGet(HD44780 *hd44780)
 {
@@ -579,3 +1113,244 @@ int hd44780_LCDCheckConnection(HD44780 *hd44780)
     return ret;
 }
 
+/*!
+	@brief  Fill the pending frame with spaces
+*/
+void hd44780_frame_clear(HD44780 *hd44780)
+{
+    memset(hd44780->frame, ' ', sizeof(hd44780->frame));
+}
+
+/*!
+	@brief  Write a string into the pending frame, clipped at the end of the line
+	@param  line  row 1-4
+	@param  col  column 0-15 or 0-19
+*/
+void hd44780_frame_write(HD44780 *hd44780, uint8_t line, uint8_t col, const char *str)
+{
+    if (str == NULL || line < 1 || line > hd44780->rows)
+        return;
+
+    while (*str && col < hd44780->cols)
+        hd44780->frame[line - 1][col++] = *str++;
+}
+
+/*!
+	@brief  Set one cell of the pending frame, for custom characters 0-7
+	@param  line  row 1-4
+	@param  col  column 0-15 or 0-19
+	@param  code  character code
+*/
+void hd44780_frame_set(HD44780 *hd44780, uint8_t line, uint8_t col, uint8_t code)
+{
+    if (line < 1 || line > hd44780->rows || col >= hd44780->cols)
+        return;
+
+    hd44780->frame[line - 1][col] = code;
+}
+
+/*!
+	@brief  Send the cells of the pending frame that differ from the display
+	@details Changed cells are grouped in runs per line, a run goes on across
+	one unchanged cell since rewriting it costs the same as a goto, and the
+	goto is skipped when the address counter is already there. Everything
+	goes out in one write.
+	@note  the entry mode is set back to LCDEntryModeThree if needed
+	@return the number of cells sent, -1 on error
+*/
+int hd44780_commit(HD44780 *hd44780)
+{
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    bool all = !hd44780->ddram_valid;
+    int cells = 0;
+
+    for (int row = 0; row < hd44780->rows; ++row)
+    {
+        if (_hd44780_line_address(hd44780, row + 1) == 0)
+            continue;
+
+        uint8_t *frame = hd44780->frame[row];
+
+        int col = 0;
+
+        while (col < hd44780->cols)
+        {
+            if (!all && hd44780->ddram[_hd44780_cell_address(hd44780, row, col)]
+                        == frame[col])
+            {
+                ++col;
+                continue;
+            }
+
+            int start = col;
+            int end = col;
+
+            for (int c = start + 1; c < hd44780->cols && c <= end + 2; ++c)
+            {
+                if (all || hd44780->ddram[_hd44780_cell_address(hd44780, row, c)]
+                           != frame[c])
+                    end = c;
+            }
+
+            if (!hd44780->increment || hd44780->autoshift)
+                _hd44780_stream_byte(hd44780, &stream, LCDEntryModeThree, false);
+
+            for (int c = start; c <= end; ++c)
+            {
+                int address = _hd44780_cell_address(hd44780, row, c);
+
+                if (hd44780->address != address || hd44780->cgram)
+                    _hd44780_stream_byte(hd44780, &stream, 0x80 | address, false);
+
+                _hd44780_stream_byte(hd44780, &stream, frame[c], true);
+            }
+
+            cells += end - start + 1;
+            col = end + 1;
+        }
+    }
+
+    bool valid = hd44780->ddram_valid || all;
+
+    if (!_hd44780_stream_send(hd44780, &stream))
+        return -1;
+
+    hd44780->ddram_valid = valid;
+
+    return cells;
+}
+
+static char _hd44780_marquee_char(HD44780Marquee *marquee, int index)
+{
+    // the text followed by the gap, repeated
+
+    int period = marquee->hardware ? HD44780_DDRAM_LINE
+                                   : marquee->len + HD44780_MARQUEE_GAP;
+
+    index %= period;
+
+    return (index < marquee->len) ? marquee->text[index] : ' ';
+}
+
+static void _hd44780_marquee_frame(HD44780 *hd44780, HD44780Marquee *marquee)
+{
+    // the pending frame follows what the marquee shows
+
+    uint8_t *frame = hd44780->frame[marquee->line - 1];
+
+    for (int col = 0; col < hd44780->cols; ++col)
+        frame[col] = _hd44780_marquee_char(marquee, marquee->pos + col);
+}
+
+/*!
+	@brief  Start scrolling a text on a line
+	@details texts up to 40 characters on 1 or 2 row displays are written
+	once in the 40 character DDRAM line and each step is a display shift
+	command, the other line shifts too. Longer texts are scrolled by
+	refilling the line through the pending frame.
+	@param  line  row 1-4
+	@param  text  text to scroll, must stay valid until stopped
+	@return false on error
+*/
+bool hd44780_marquee_start(HD44780 *hd44780, HD44780Marquee *marquee,
+                           uint8_t line, const char *text)
+{
+    if (text == NULL || line < 1 || line > hd44780->rows)
+        return false;
+
+    marquee->line = line;
+    marquee->text = text;
+    marquee->len = strlen(text);
+    marquee->pos = 0;
+    marquee->hardware = (marquee->len <= HD44780_DDRAM_LINE && hd44780->rows <= 2);
+
+    if (!marquee->hardware)
+    {
+        _hd44780_marquee_frame(hd44780, marquee);
+        return (hd44780_commit(hd44780) >= 0);
+    }
+
+    // the whole DDRAM line, starting at the visible column 0
+
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    int base = _hd44780_cell_address(hd44780, line - 1, 0);
+
+    _hd44780_stream_byte(hd44780, &stream, 0x80 | base, false);
+
+    for (int i = 0; i < HD44780_DDRAM_LINE; ++i)
+    {
+        int address = _hd44780_cell_address(hd44780, line - 1, i);
+
+        // wrapping inside the line
+        if (hd44780->address != address)
+            _hd44780_stream_byte(hd44780, &stream, 0x80 | address, false);
+
+        _hd44780_stream_byte(hd44780, &stream, _hd44780_marquee_char(marquee, i), true);
+    }
+
+    _hd44780_marquee_frame(hd44780, marquee);
+
+    return _hd44780_stream_send(hd44780, &stream);
+}
+
+/*!
+	@brief  Move a marquee one character to the left
+	@note  in hardware mode call hd44780_commit() afterwards if the other
+	line must stay still
+	@return false on error
+*/
+bool hd44780_marquee_step(HD44780 *hd44780, HD44780Marquee *marquee)
+{
+    marquee->pos++;
+
+    _hd44780_marquee_frame(hd44780, marquee);
+
+    if (!marquee->hardware)
+        return (hd44780_commit(hd44780) >= 0);
+
+    // Command Byte Code: Scroll display one character left (all lines)
+    const uint8_t LCDScrollLeft = 0x18;
+
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    _hd44780_stream_byte(hd44780, &stream, LCDScrollLeft, false);
+
+    return _hd44780_stream_send(hd44780, &stream);
+}
+
+/*!
+	@brief  Stop a marquee, the display shift is undone by the shortest way
+	@details the line keeps the last text shown in the pending frame
+	@return false on error
+*/
+bool hd44780_marquee_stop(HD44780 *hd44780, HD44780Marquee *marquee)
+{
+    if (!marquee->hardware)
+        return true;
+
+    marquee->hardware = false;
+
+    const uint8_t LCDScrollRight = 0x1E;
+    const uint8_t LCDScrollLeft = 0x18;
+
+    HD44780Stream stream;
+    _hd44780_stream_init(&stream);
+
+    while (hd44780->shift != 0)
+    {
+        uint8_t cmd = (hd44780->shift <= HD44780_DDRAM_LINE / 2) ? LCDScrollRight
+                                                                 : LCDScrollLeft;
+
+        _hd44780_stream_byte(hd44780, &stream, cmd, false);
+    }
+
+    if (!_hd44780_stream_send(hd44780, &stream))
+        return false;
+
+    return (hd44780_commit(hd44780) >= 0);
+}
@@ -9,10 +9,21 @@
 #include <stdbool.h>
 #include <unistd.h>
 
+#define HD44780_MAX_ROWS 4
+#define HD44780_MAX_COLS 40
+#define HD44780_DDRAM_SIZE 0x80
+#define HD44780_CGRAM_SLOTS 8
+
+typedef ssize_t (*HD44780WriteFunc)(void *user, const void *data, int len);
+
 typedef struct hd44780
 {
     int file;
 
+    // expander bytes go to this callback instead of the file when set
+    HD44780WriteFunc on_write;
+    void *user;
+
     int channel;
     uint8_t addr;
     uint8_t cols;
@@ -20,15 +31,57 @@ typedef struct hd44780
 
     uint8_t backlight;
 
-    uint16_t _I2C_ErrorDelay;   // retry delay in event of error in ms
+    uint16_t _I2C_ErrorDelay;   // first retry delay in event of error in us
     uint8_t _I2C_ErrorRetryNum; // number of retry attempts
-    int _I2C_ErrorFlag;         // error code
+    int _I2C_ErrorFlag;         // last write error, -errno
+
+    bool busypoll;              // wait on the busy flag instead of sleeping
+    uint16_t busy_timeout;      // busy flag timeout in us
+
+    // shadow of the display memory, updated by every byte sent,
+    // indexed by DDRAM address
+    uint8_t ddram[HD44780_DDRAM_SIZE];
+    bool ddram_valid;           // false until the content is known
+    int address;                // DDRAM address counter, -1 if unknown
+    bool cgram;                 // the address counter points in CGRAM
+    bool increment;             // entry mode increments the address
+    bool autoshift;             // entry mode shifts the display
+    int shift;                  // display shift, characters to the left
+    uint8_t display;            // display control command, for a resync
+
+    // pending frame, sent by hd44780_commit()
+    uint8_t frame[HD44780_MAX_ROWS][HD44780_MAX_COLS];
+
+    // custom characters in CGRAM, the slot content is kept to
+    // tell hash collisions apart
+    bool cg_used[HD44780_CGRAM_SLOTS];
+    uint32_t cg_hash[HD44780_CGRAM_SLOTS];
+    uint8_t cg_glyph[HD44780_CGRAM_SLOTS][8];
+    uint32_t cg_stamp[HD44780_CGRAM_SLOTS];    // last use
+    uint32_t cg_clock;
 
     //int _LCDI2CFlags;
     //int _LCDI2CHandle;
 
 } HD44780;
 
+// scrolling text on one line, texts up to 40 characters on 1 or 2 row
+// displays are loaded once in the DDRAM line and moved with the display
+// shift, the other line moves too and is restored by hd44780_commit(),
+// longer texts are scrolled by refilling the visible window
+#define HD44780_DDRAM_LINE 40
+#define HD44780_MARQUEE_GAP 4
+
+typedef struct hd44780_marquee
+{
+    uint8_t line;
+    const char *text;   // owned by the caller
+    int len;
+    int pos;            // first character shown
+    bool hardware;      // display shift instead of refill
+
+} HD44780Marquee;
+
 // backlight control
 #define LCDBackLightOnMask      0x0F    // XXXX-1111 Turn on Back light
 #define LCDBackLightOffMask     0x07    // XXXX-0111 Turn off Back light
@@ -57,10 +110,15 @@ typedef struct hd44780
 
 bool hd44780_init(HD44780 *hd44780, int channel, int addr,
                   int cols, int rows, uint8_t cursor_type);
+bool hd44780_init_callback(HD44780 *hd44780, HD44780WriteFunc on_write, void *user,
+                           int cols, int rows, uint8_t cursor_type);
 void hd44780_close(HD44780 *hd44780);
 
 inline ssize_t hd44780_write(HD44780 *hd44780, const void *data, int len)
 {
+    if (hd44780->on_write)
+        return hd44780->on_write(hd44780->user, data, len);
+
     return write(hd44780->file, data, len);
 }
 
@@ -74,12 +132,28 @@ void hd44780_LCDMoveCursor(HD44780 *hd44780, uint8_t direction, uint8_t num);
 void hd44780_LCDScroll(HD44780 *hd44780, uint8_t direction, uint8_t ScrollSize);
 void hd44780_goto(HD44780 *hd44780, uint8_t line, uint8_t col);
 void hd44780_set_backlight(HD44780 *hd44780, bool on);
+void hd44780_set_busypoll(HD44780 *hd44780, bool on, uint16_t timeout_us);
+int hd44780_read_status(HD44780 *hd44780);
 bool hd44780_LCDBackLightGet(HD44780 *hd44780);
+bool hd44780_LCDCreateCustomChar(HD44780 *hd44780, uint8_t location, uint8_t *charmap);
+int hd44780_custom_char(HD44780 *hd44780, const uint8_t *charmap);
 void hd44780_LCDPrintCustomChar(HD44780 *hd44780, uint8_t location);
 void hd44780_LCDClearScreenCmd(HD44780 *hd44780);
 void hd44780_LCDHome(HD44780 *hd44780);
 void hd44780_LCDChangeEntryMode(HD44780 *hd44780, uint8_t newEntryMode);
 
+// frame buffer, drawing only changes the pending frame and
+// hd44780_commit() sends the cells that differ from the display
+void hd44780_frame_clear(HD44780 *hd44780);
+void hd44780_frame_write(HD44780 *hd44780, uint8_t line, uint8_t col, const char *str);
+void hd44780_frame_set(HD44780 *hd44780, uint8_t line, uint8_t col, uint8_t code);
+int hd44780_commit(HD44780 *hd44780);
+
+bool hd44780_marquee_start(HD44780 *hd44780, HD44780Marquee *marquee,
+                           uint8_t line, const char *text);
+bool hd44780_marquee_step(HD44780 *hd44780, HD44780Marquee *marquee);
+bool hd44780_marquee_stop(HD44780 *hd44780, HD44780Marquee *marquee);
+
 int hd44780_LCDI2CErrorGet(HD44780 *hd44780);
 void hd44780_LCDI2CErrorTimeoutSet(HD44780 *hd44780, uint16_t newTimeout);
 uint16_t hd44780_LCDI2CErrorTimeoutGet(HD44780 *hd44780);
@@ -0,0 +1,285 @@
+// hd44780_bench : bus cost of the HD44780 operations
+//
+// Every operation is run on a 20x4 display with the simulator as the
+// bus, the expander bytes and writes are counted and the simulated
+// controller is checked against the driver shadow afterwards, and
+// against the expected rows when a case gives them.
+//
+// Each write is one I2C transaction, the bus time is estimated at 100,
+// 400 and 1000 kHz with 9 clocks per byte (8 bits and ack), a start and
+// address byte and a stop per transaction. The command delays and the
+// syscall cost aren't counted.
+
+#include <hd44780.h>
+#include <hd44780_layout.h>
+#include <hd44780_sim.h>
+#include <hd44780_widget.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct bench_case
+{
+    const char *name;
+    void (*setup)(HD44780 *hd44780);    // content before the operation
+    void (*run)(HD44780 *hd44780);
+    const char *const *expect;          // rows afterwards, NULL to skip
+
+} BenchCase;
+
+static HD44780Marquee _marquee;
+
+static const uint8_t _glyph[8] = {0x04, 0x0e, 0x1f, 0x04, 0x04, 0x04, 0x04, 0x00};
+
+static HD44780Field _fields[] =
+{
+    {1, 13, 5, HD44780_ALIGN_RIGHT, 1},
+    {2, 15, 3, HD44780_ALIGN_RIGHT, 0},
+};
+
+static const HD44780Layout _layout =
+{
+    {"Temperature        C", "Humidity           %", NULL, NULL},
+    _fields,
+    2,
+};
+
+// operations -----------------------------------------------------------------
+
+static void _run_write_char(HD44780 *hd44780)
+{
+    hd44780_write_char(hd44780, 'A');
+}
+
+static void _run_write_string(HD44780 *hd44780)
+{
+    hd44780_write_string(hd44780, "Hello World 12345678");
+}
+
+static void _run_goto(HD44780 *hd44780)
+{
+    hd44780_goto(hd44780, LCDLineNumberThree, 5);
+}
+
+static void _run_goto_write(HD44780 *hd44780)
+{
+    hd44780_goto(hd44780, LCDLineNumberTwo, 0);
+    hd44780_write_string(hd44780, "Line two");
+}
+
+static void _run_clear_screen(HD44780 *hd44780)
+{
+    hd44780_clear_screen(hd44780);
+}
+
+static void _run_clear_line(HD44780 *hd44780)
+{
+    hd44780_clear_line(hd44780, LCDLineNumberFour);
+}
+
+static void _run_scroll(HD44780 *hd44780)
+{
+    hd44780_LCDScroll(hd44780, LCDMoveLeft, 1);
+}
+
+static void _run_scroll_10(HD44780 *hd44780)
+{
+    hd44780_LCDScroll(hd44780, LCDMoveRight, 10);
+}
+
+static void _run_custom_char(HD44780 *hd44780)
+{
+    hd44780_LCDCreateCustomChar(hd44780, 3, (uint8_t*) _glyph);
+}
+
+static void _run_commit_full(HD44780 *hd44780)
+{
+    hd44780_frame_write(hd44780, 1, 0, "Temperature  23.5 C");
+    hd44780_frame_write(hd44780, 2, 0, "Humidity     45   %");
+    hd44780_frame_write(hd44780, 3, 0, "Pressure   1013 hPa");
+    hd44780_frame_write(hd44780, 4, 0, "Uptime   12:34:56");
+    hd44780_commit(hd44780);
+}
+
+static void _run_commit_small(HD44780 *hd44780)
+{
+    hd44780_frame_write(hd44780, 1, 15, "6");
+    hd44780_frame_write(hd44780, 4, 16, "7");
+    hd44780_commit(hd44780);
+}
+
+static void _run_hbar(HD44780 *hd44780)
+{
+    hd44780_hbar(hd44780, 4, 0, 20, 37, 100, true);
+}
+
+static void _run_marquee_step(HD44780 *hd44780)
+{
+    hd44780_marquee_step(hd44780, &_marquee);
+}
+
+static void _run_layout_draw(HD44780 *hd44780)
+{
+    hd44780_layout_draw(hd44780, &_layout, false);
+    hd44780_field_set_fixed(hd44780, &_fields[0], 235, 1, false);
+    hd44780_field_set_int(hd44780, &_fields[1], 45, true);
+}
+
+static void _run_layout_field(HD44780 *hd44780)
+{
+    hd44780_field_set_fixed(hd44780, &_fields[0], 23649, 3, true);
+}
+
+// content --------------------------------------------------------------------
+
+static void _setup_text(HD44780 *hd44780)
+{
+    hd44780_frame_write(hd44780, 1, 0, "Temperature  23.5 C");
+    hd44780_frame_write(hd44780, 2, 0, "Humidity     45   %");
+    hd44780_frame_write(hd44780, 3, 0, "Pressure   1013 hPa");
+    hd44780_frame_write(hd44780, 4, 0, "Uptime   12:34:56");
+    hd44780_commit(hd44780);
+}
+
+static void _setup_marquee(HD44780 *hd44780)
+{
+    _setup_text(hd44780);
+    hd44780_marquee_start(hd44780, &_marquee, 1, "A message scrolling on line one");
+}
+
+static void _setup_layout(HD44780 *hd44780)
+{
+    _run_layout_draw(hd44780);
+}
+
+static const char *const _expect_layout_draw[HD44780_MAX_ROWS] =
+{
+    "Temperature   23.5 C",
+    "Humidity        45 %",
+    "",
+    "",
+};
+
+static const char *const _expect_layout_field[HD44780_MAX_ROWS] =
+{
+    "Temperature   23.6 C",
+    "Humidity        45 %",
+    "",
+    "",
+};
+
+static const BenchCase _cases[] =
+{
+    {"write_char",      NULL,           _run_write_char,    NULL},
+    {"write_string",    NULL,           _run_write_string,  NULL},
+    {"goto",            NULL,           _run_goto,          NULL},
+    {"goto+string",     NULL,           _run_goto_write,    NULL},
+    {"clear_screen",    _setup_text,    _run_clear_screen,  NULL},
+    {"clear_line",      _setup_text,    _run_clear_line,    NULL},
+    {"scroll 1",        _setup_text,    _run_scroll,        NULL},
+    {"scroll 10",       _setup_text,    _run_scroll_10,     NULL},
+    {"custom_char",     NULL,           _run_custom_char,   NULL},
+    {"commit full",     NULL,           _run_commit_full,   NULL},
+    {"commit 2 cells",  _setup_text,    _run_commit_small,  NULL},
+    {"hbar",            _setup_text,    _run_hbar,          NULL},
+    {"marquee step",    _setup_marquee, _run_marquee_step,  NULL},
+    {"layout draw",     NULL,           _run_layout_draw,   _expect_layout_draw},
+    {"layout field",    _setup_layout,  _run_layout_field,  _expect_layout_field},
+};
+
+#define CASE_COUNT (int) (sizeof(_cases) / sizeof(_cases[0]))
+
+// i2c time estimate ----------------------------------------------------------
+
+static double _bus_time_us(const HD44780Sim *sim, double hz)
+{
+    double clocks = 9.0 * sim->bytes        // data bytes and ack
+                    + 10.0 * sim->writes    // start and address byte
+                    + 1.0 * sim->writes;    // stop
+
+    return clocks * 1000000.0 / hz;
+}
+
+// simulated DDRAM --------------------------------------------------------------
+
+static int _check_rows(HD44780Sim *sim, const char *const *expect)
+{
+    // count the cells that differ from the expected rows,
+    // a row shorter than the display is blank to the end
+
+    int diff = 0;
+
+    for (int row = 0; row < sim->rows; ++row)
+    {
+        int len = strlen(expect[row]);
+
+        for (int col = 0; col < sim->cols; ++col)
+        {
+            char c = (col < len) ? expect[row][col] : ' ';
+
+            if (hd44780_sim_get_char(sim, row, col) != (uint8_t) c)
+                diff++;
+        }
+    }
+
+    return diff;
+}
+
+int main()
+{
+    int errors = 0;
+
+    printf("HD44780 20x4 on PCF8574\n");
+    printf("%-16s %7s %6s %5s %9s %9s %9s  %s\n",
+           "operation", "bytes", "writes", "cmds",
+           "100kHz us", "400kHz us", "1MHz us", "ddram");
+
+    for (int i = 0; i < CASE_COUNT; ++i)
+    {
+        const BenchCase *bc = &_cases[i];
+
+        HD44780 hd44780;
+        HD44780Sim sim;
+
+        hd44780_sim_init(&sim, 20, 4);
+
+        if (!hd44780_init_callback(&hd44780, hd44780_sim_write, &sim,
+                                   20, 4, LCDCursorTypeOff))
+            return EXIT_FAILURE;
+
+        if (bc->setup)
+            bc->setup(&hd44780);
+
+        // only count the operation
+        hd44780_sim_reset_stats(&sim);
+
+        bc->run(&hd44780);
+
+        int diff = hd44780_sim_compare(&sim, &hd44780);
+
+        if (bc->expect)
+            diff += _check_rows(&sim, bc->expect);
+
+        if (diff)
+            errors++;
+
+        printf("%-16s %7lu %6lu %5lu %9.0f %9.0f %9.0f  %s\n",
+               bc->name, sim.bytes, sim.writes, sim.commands,
+               _bus_time_us(&sim, 100000.0),
+               _bus_time_us(&sim, 400000.0),
+               _bus_time_us(&sim, 1000000.0),
+               diff ? "DIFF" : "ok");
+
+        if (diff)
+            hd44780_sim_print(&sim, stderr);
+
+        hd44780_close(&hd44780);
+    }
+
+    if (errors)
+        fprintf(stderr, "\n%d operation(s) left the display out of sync\n", errors);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
@@ -0,0 +1,186 @@
+// dashboard layout for the HD44780
+//
+// A template such as "T:      C  H:    %" is drawn once, each value goes
+// in a field of fixed width, formatted without snprintf or the heap.
+// Fields only write into the pending frame, hd44780_commit() then sends
+// the characters that differ from what is on the display.
+
+#include <hd44780_layout.h>
+#include <string.h>
+
+#define LCDFieldOverflow        '#'
+
+static const uint32_t _pow10[10] =
+{
+    1, 10, 100, 1000, 10000, 100000, 1000000,
+    10000000, 100000000, 1000000000
+};
+
+int hd44780_format_fixed(char *buffer, int size, int32_t value,
+                         uint8_t scale, uint8_t decimals)
+{
+    if (scale > 9 || decimals > 9)
+        return -1;
+
+    bool negative = (value < 0);
+    uint64_t magnitude = negative ? -(int64_t) value : value;
+
+    // rescale to the digits shown, rounding half away from zero
+
+    if (decimals < scale)
+    {
+        uint32_t div = _pow10[scale - decimals];
+        magnitude = (magnitude + div / 2) / div;
+    }
+    else
+    {
+        magnitude *= _pow10[decimals - scale];
+    }
+
+    // digits from the right
+
+    char digits[24];
+    int count = 0;
+
+    do
+    {
+        digits[count++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    }
+    while (magnitude > 0 || count <= decimals);
+
+    // no "-0.0" when the value rounds to zero
+
+    bool zero = true;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (digits[i] != '0')
+            zero = false;
+    }
+
+    if (zero)
+        negative = false;
+
+    int len = count + (decimals ? 1 : 0) + (negative ? 1 : 0);
+
+    if (len >= size)
+        return -1;
+
+    char *p = buffer;
+
+    if (negative)
+        *p++ = '-';
+
+    for (int i = count - 1; i >= 0; --i)
+    {
+        *p++ = digits[i];
+
+        if (i == decimals && decimals)
+            *p++ = '.';
+    }
+
+    *p = 0;
+
+    return len;
+}
+
+static void _hd44780_field_put(HD44780 *hd44780, const HD44780Field *field,
+                               const char *text, int len)
+{
+    // aligned in the field, filled with # if it doesn't fit
+
+    int pad = field->width - len;
+
+    for (int i = 0; i < field->width; ++i)
+    {
+        char c = ' ';
+
+        if (len < 0 || pad < 0)
+            c = LCDFieldOverflow;
+        else if (field->align == HD44780_ALIGN_RIGHT)
+            c = (i >= pad) ? text[i - pad] : ' ';
+        else
+            c = (i < len) ? text[i] : ' ';
+
+        hd44780_frame_set(hd44780, field->line, field->col + i, c);
+    }
+}
+
+static bool _hd44780_field_render(HD44780 *hd44780, bool render)
+{
+    if (render)
+        return (hd44780_commit(hd44780) >= 0);
+
+    return true;
+}
+
+/*!
+	@brief  Draw the template in the pending frame and blank the fields
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_layout_draw(HD44780 *hd44780, const HD44780Layout *layout, bool render)
+{
+    hd44780_frame_clear(hd44780);
+
+    for (int line = 1; line <= hd44780->rows; ++line)
+    {
+        const char *text = layout->lines[line - 1];
+
+        if (text)
+            hd44780_frame_write(hd44780, line, 0, text);
+    }
+
+    for (int i = 0; i < layout->count; ++i)
+        _hd44780_field_put(hd44780, &layout->fields[i], "", 0);
+
+    return _hd44780_field_render(hd44780, render);
+}
+
+/*!
+	@brief  Show a text in a field
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_field_set_text(HD44780 *hd44780, const HD44780Field *field,
+                            const char *text, bool render)
+{
+    if (text == NULL)
+        return false;
+
+    _hd44780_field_put(hd44780, field, text, strlen(text));
+
+    return _hd44780_field_render(hd44780, render);
+}
+
+/*!
+	@brief  Show an integer in a field
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_field_set_int(HD44780 *hd44780, const HD44780Field *field,
+                           int32_t value, bool render)
+{
+    return hd44780_field_set_fixed(hd44780, field, value, 0, render);
+}
+
+/*!
+	@brief  Show a fixed point value in a field
+	@details the value is value / 10^scale, shown with the field decimals,
+	e.g. 23456 with a scale of 3 and 1 decimal shows 23.5
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_field_set_fixed(HD44780 *hd44780, const HD44780Field *field,
+                             int32_t value, uint8_t scale, bool render)
+{
+    char text[24];
+
+    int len = hd44780_format_fixed(text, sizeof(text), value, scale, field->decimals);
+
+    _hd44780_field_put(hd44780, field, text, len);
+
+    return _hd44780_field_render(hd44780, render);
+}
+
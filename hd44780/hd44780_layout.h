@@ -0,0 +1,49 @@
+#ifndef __HD44780_LAYOUT_H__
+#define __HD44780_LAYOUT_H__
+
+#include <hd44780.h>
+
+// fixed template with value fields, the template is drawn once and the
+// setters only change the field cells of the pending frame, with render
+// they are committed right away so only changed characters are sent
+
+enum
+{
+    HD44780_ALIGN_LEFT = 0,
+    HD44780_ALIGN_RIGHT
+};
+
+typedef struct hd44780_field
+{
+    uint8_t line;       // row 1-4
+    uint8_t col;
+    uint8_t width;
+    uint8_t align;
+    uint8_t decimals;   // digits shown after the point
+
+} HD44780Field;
+
+typedef struct hd44780_layout
+{
+    const char *lines[HD44780_MAX_ROWS];    // template, NULL for blank
+    HD44780Field *fields;
+    int count;
+
+} HD44780Layout;
+
+bool hd44780_layout_draw(HD44780 *hd44780, const HD44780Layout *layout, bool render);
+
+bool hd44780_field_set_text(HD44780 *hd44780, const HD44780Field *field,
+                            const char *text, bool render);
+bool hd44780_field_set_int(HD44780 *hd44780, const HD44780Field *field,
+                           int32_t value, bool render);
+bool hd44780_field_set_fixed(HD44780 *hd44780, const HD44780Field *field,
+                             int32_t value, uint8_t scale, bool render);
+
+// value / 10^scale with decimals digits after the point, rounded,
+// returns the length or -1 if it doesn't fit
+int hd44780_format_fixed(char *buffer, int size, int32_t value,
+                         uint8_t scale, uint8_t decimals);
+
+#endif
+
@@ -0,0 +1,288 @@
+// PCF8574 and HD44780 model
+//
+// The expander drives the LCD with its 8 outputs : P0 RS, P1 RW, P2 EN,
+// P3 backlight and P4-P7 the data pins D4-D7. The controller latches
+// the data pins on the falling edge of EN, a byte takes two nibbles in
+// 4-bit mode, upper first.
+
+#include <hd44780_sim.h>
+#include <string.h>
+
+#define SIM_PIN_RS 0x01
+#define SIM_PIN_RW 0x02
+#define SIM_PIN_EN 0x04
+#define SIM_PIN_BACKLIGHT 0x08
+
+void hd44780_sim_init(HD44780Sim *sim, int cols, int rows)
+{
+    memset(sim, 0, sizeof(HD44780Sim));
+
+    sim->cols = cols;
+    sim->rows = rows;
+
+    sim->eight = true;
+    sim->nibble = -1;
+
+    memset(sim->ddram, ' ', HD44780_DDRAM_SIZE);
+
+    sim->increment = true;
+    sim->function = 0x30;
+}
+
+void hd44780_sim_reset_stats(HD44780Sim *sim)
+{
+    sim->bytes = 0;
+    sim->writes = 0;
+    sim->commands = 0;
+    sim->data = 0;
+}
+
+static int _sim_next_address(int address, bool increment)
+{
+    // two line mode, lines are 0x00-0x27 and 0x40-0x67
+
+    if (increment)
+    {
+        if (address == 0x27)
+            return 0x40;
+
+        if (address == 0x67)
+            return 0x00;
+
+        return address + 1;
+    }
+
+    if (address == 0x00)
+        return 0x67;
+
+    if (address == 0x40)
+        return 0x27;
+
+    return address - 1;
+}
+
+static void _sim_shift(HD44780Sim *sim, int count)
+{
+    sim->shift = (sim->shift + count + 40) % 40;
+}
+
+static void _sim_command(HD44780Sim *sim, uint8_t value)
+{
+    sim->commands++;
+
+    if (value & 0x80) // set DDRAM address
+    {
+        sim->address = value & 0x7f;
+        sim->cgram_mode = false;
+    }
+    else if (value & 0x40) // set CGRAM address
+    {
+        sim->address = value & 0x3f;
+        sim->cgram_mode = true;
+    }
+    else if (value & 0x20) // function set
+    {
+        sim->function = value;
+        sim->eight = value & 0x10;
+        sim->nibble = -1;
+    }
+    else if (value & 0x10) // cursor or display shift
+    {
+        bool right = value & 0x04;
+
+        if (value & 0x08)
+            _sim_shift(sim, right ? -1 : 1);
+        else if (sim->cgram_mode)
+            sim->address = (sim->address + (right ? 1 : -1)) & 0x3f;
+        else
+            sim->address = _sim_next_address(sim->address, right);
+    }
+    else if (value & 0x08) // display control
+    {
+        sim->display_on = value & 0x04;
+        sim->cursor = value & 0x02;
+        sim->blink = value & 0x01;
+    }
+    else if (value & 0x04) // entry mode
+    {
+        sim->increment = value & 0x02;
+        sim->autoshift = value & 0x01;
+    }
+    else if (value & 0x02) // home
+    {
+        sim->address = 0;
+        sim->cgram_mode = false;
+        sim->shift = 0;
+    }
+    else if (value & 0x01) // clear
+    {
+        memset(sim->ddram, ' ', HD44780_DDRAM_SIZE);
+        sim->address = 0;
+        sim->cgram_mode = false;
+        sim->increment = true;
+        sim->shift = 0;
+    }
+}
+
+static void _sim_data(HD44780Sim *sim, uint8_t value)
+{
+    sim->data++;
+
+    if (sim->cgram_mode)
+    {
+        sim->cgram[sim->address] = value & 0x1f;
+        sim->address = (sim->address + (sim->increment ? 1 : -1)) & 0x3f;
+        return;
+    }
+
+    sim->ddram[sim->address] = value;
+    sim->address = _sim_next_address(sim->address, sim->increment);
+
+    if (sim->autoshift)
+        _sim_shift(sim, sim->increment ? 1 : -1);
+}
+
+static void _sim_latch(HD44780Sim *sim, uint8_t port)
+{
+    // EN falling edge, reads are ignored
+
+    if (port & SIM_PIN_RW)
+        return;
+
+    bool rs = port & SIM_PIN_RS;
+    uint8_t nibble = port >> 4;
+    int value;
+
+    if (sim->eight)
+    {
+        value = nibble << 4;
+    }
+    else if (sim->nibble < 0)
+    {
+        sim->nibble = nibble;
+        return;
+    }
+    else
+    {
+        value = (sim->nibble << 4) | nibble;
+        sim->nibble = -1;
+    }
+
+    if (rs)
+        _sim_data(sim, value);
+    else
+        _sim_command(sim, value);
+}
+
+ssize_t hd44780_sim_write(void *user, const void *data, int len)
+{
+    HD44780Sim *sim = (HD44780Sim*) user;
+    const uint8_t *bytes = (const uint8_t*) data;
+
+    for (int i = 0; i < len; ++i)
+    {
+        uint8_t port = bytes[i];
+
+        if ((sim->port & SIM_PIN_EN) && !(port & SIM_PIN_EN))
+            _sim_latch(sim, sim->port);
+
+        sim->port = port;
+        sim->backlight = port & SIM_PIN_BACKLIGHT;
+    }
+
+    sim->bytes += len;
+    sim->writes++;
+
+    return len;
+}
+
+static int _sim_line_offset(HD44780Sim *sim, int row)
+{
+    static const uint8_t offsets[4] = {0x00, 0x40, 0x14, 0x54};
+
+    int offset = offsets[row];
+
+    // 16 columns displays start the lines 3 and 4 at 0x10 and 0x50
+    if (row >= 2 && sim->cols == 16)
+        offset -= 4;
+
+    return offset;
+}
+
+uint8_t hd44780_sim_get_char(HD44780Sim *sim, int row, int col)
+{
+    if (row < 0 || row >= sim->rows || col < 0 || col >= sim->cols)
+        return ' ';
+
+    int address = _sim_line_offset(sim, row) + col;
+    int line = address & 0x40;
+
+    return sim->ddram[line | (((address & 0x3f) + sim->shift) % 40)];
+}
+
+int hd44780_sim_compare(HD44780Sim *sim, const HD44780 *hd44780)
+{
+    int diff = 0;
+
+    if (hd44780->ddram_valid)
+    {
+        for (int line = 0x00; line <= 0x40; line += 0x40)
+        {
+            for (int i = 0; i < 40; ++i)
+            {
+                if (sim->ddram[line + i] != hd44780->ddram[line + i])
+                    diff++;
+            }
+        }
+
+        if (sim->shift != hd44780->shift)
+            diff++;
+    }
+
+    if (hd44780->address >= 0 && !hd44780->cgram
+        && (sim->cgram_mode || sim->address != hd44780->address))
+        diff++;
+
+    if (sim->increment != hd44780->increment || sim->autoshift != hd44780->autoshift)
+        diff++;
+
+    for (int slot = 0; slot < HD44780_CGRAM_SLOTS; ++slot)
+    {
+        if (!hd44780->cg_used[slot])
+            continue;
+
+        for (int i = 0; i < 8; ++i)
+        {
+            if (sim->cgram[slot * 8 + i] != (hd44780->cg_glyph[slot][i] & 0x1f))
+            {
+                diff++;
+                break;
+            }
+        }
+    }
+
+    return diff;
+}
+
+void hd44780_sim_print(HD44780Sim *sim, FILE *fp)
+{
+    for (int row = 0; row < sim->rows; ++row)
+    {
+        fputc('|', fp);
+
+        for (int col = 0; col < sim->cols; ++col)
+        {
+            uint8_t c = hd44780_sim_get_char(sim, row, col);
+
+            if (c < 16)
+                fputc('0' + (c & 7), fp);
+            else if (c < 0x20 || c >= 0x7f)
+                fputc('#', fp);
+            else
+                fputc(c, fp);
+        }
+
+        fputs("|\n", fp);
+    }
+}
+
@@ -0,0 +1,67 @@
+#ifndef __HD44780_SIM_H__
+#define __HD44780_SIM_H__
+
+#include <hd44780.h>
+#include <stdio.h>
+
+// PCF8574 and HD44780 model, decodes the expander bytes into a
+// simulated controller so what hd44780.c sends can be checked and
+// measured without a panel, the command timings are not modeled
+
+#define HD44780_SIM_CGRAM_SIZE 64
+
+typedef struct hd44780_sim
+{
+    int cols;
+    int rows;
+
+    // expander
+    uint8_t port;           // last byte, the EN falling edge latches
+    bool backlight;
+
+    // interface, 8-bit after power on, the lower data pins are low
+    bool eight;
+    int nibble;             // upper nibble waiting for the lower, -1 if none
+
+    uint8_t ddram[HD44780_DDRAM_SIZE];
+    uint8_t cgram[HD44780_SIM_CGRAM_SIZE];
+
+    // address counter
+    int address;
+    bool cgram_mode;
+    bool increment;
+    bool autoshift;
+    int shift;              // characters to the left
+
+    uint8_t function;
+    bool display_on;
+    bool cursor;
+    bool blink;
+
+    unsigned long bytes;        // expander bytes
+    unsigned long writes;       // I2C transactions
+    unsigned long commands;     // decoded commands
+    unsigned long data;         // decoded data bytes
+
+} HD44780Sim;
+
+// power on state, DDRAM filled with spaces and the 8-bit interface
+void hd44780_sim_init(HD44780Sim *sim, int cols, int rows);
+
+// write callback for hd44780_init_callback(), user is the simulator
+ssize_t hd44780_sim_write(void *user, const void *data, int len);
+
+// clear the byte counters
+void hd44780_sim_reset_stats(HD44780Sim *sim);
+
+// character code shown at a visible cell, row 0-3
+uint8_t hd44780_sim_get_char(HD44780Sim *sim, int row, int col);
+
+// cells and state that differ from the driver shadow, 0 if in sync
+int hd44780_sim_compare(HD44780Sim *sim, const HD44780 *hd44780);
+
+// print the visible screen, custom characters as their code
+void hd44780_sim_print(HD44780Sim *sim, FILE *fp);
+
+#endif
+
@@ -0,0 +1,260 @@
+// bar graphs and big digits for the HD44780
+//
+// A character cell is 5x8 pixels, bars use the solid block of the
+// character ROM (0xFF) for full cells and one custom character for
+// the partial cell, so a bar costs a single CGRAM slot and moving it
+// by one pixel changes one cell.
+//
+// Big digits are 3 columns wide and 2 or 4 rows high, drawn as seven
+// segments : vertical segments are solid blocks, horizontal ones are
+// a top, bottom or top and bottom bar glyph.
+
+#include <hd44780_widget.h>
+
+#define LCDCharBlock            0xFF // solid block in the character ROM
+#define LCDCharSpace            ' '
+
+// seven segment bits
+#define SEG_A 0x01
+#define SEG_B 0x02
+#define SEG_C 0x04
+#define SEG_D 0x08
+#define SEG_E 0x10
+#define SEG_F 0x20
+#define SEG_G 0x40
+
+static const uint8_t _segments[10] =
+{
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,          // 0
+    SEG_B | SEG_C,                                          // 1
+    SEG_A | SEG_B | SEG_D | SEG_E | SEG_G,                  // 2
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_G,                  // 3
+    SEG_B | SEG_C | SEG_F | SEG_G,                          // 4
+    SEG_A | SEG_C | SEG_D | SEG_F | SEG_G,                  // 5
+    SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,          // 6
+    SEG_A | SEG_B | SEG_C,                                  // 7
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,  // 8
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,          // 9
+};
+
+// segments of each digit row : left, right, top bar, bottom bar
+typedef struct big_row
+{
+    uint8_t left;
+    uint8_t right;
+    uint8_t top;
+    uint8_t bottom;
+
+} BigRow;
+
+static const BigRow _rows2[2] =
+{
+    {SEG_F, SEG_B, SEG_A, SEG_G},
+    {SEG_E, SEG_C, 0,     SEG_D},
+};
+
+static const BigRow _rows4[4] =
+{
+    {SEG_F, SEG_B, SEG_A, 0},
+    {SEG_F, SEG_B, 0,     SEG_G},
+    {SEG_E, SEG_C, SEG_G, 0},
+    {SEG_E, SEG_C, 0,     SEG_D},
+};
+
+static uint8_t _glyph_code(HD44780 *hd44780, const uint8_t *glyph, uint8_t fallback)
+{
+    // custom character from the cache, a ROM character if CGRAM is full
+
+    int code = hd44780_custom_char(hd44780, glyph);
+
+    return (code < 0) ? fallback : code;
+}
+
+static uint8_t _bar_cell(HD44780 *hd44780, int fill, bool vertical)
+{
+    // cell of a bar with fill pixels lit, 5 columns or 8 rows
+
+    int size = vertical ? 8 : 5;
+
+    if (fill <= 0)
+        return LCDCharSpace;
+
+    if (fill >= size)
+        return LCDCharBlock;
+
+    uint8_t glyph[8];
+
+    for (int i = 0; i < 8; ++i)
+    {
+        if (vertical)
+            glyph[i] = (i >= 8 - fill) ? 0x1f : 0x00;
+        else
+            glyph[i] = (0x1f << (5 - fill)) & 0x1f;
+    }
+
+    return _glyph_code(hd44780, glyph, LCDCharSpace);
+}
+
+static int _bar_pixels(int value, int max, int cells, int size)
+{
+    if (max <= 0 || value <= 0)
+        return 0;
+
+    if (value >= max)
+        return cells * size;
+
+    return (int) (((long) value * cells * size + max / 2) / max);
+}
+
+/*!
+	@brief  Horizontal bar growing to the right, 5 pixels per cell
+	@param  line  row 1-4
+	@param  col  first column
+	@param  width  number of cells
+	@param  value  0 to max
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_hbar(HD44780 *hd44780, uint8_t line, uint8_t col, uint8_t width,
+                  int value, int max, bool render)
+{
+    if (line < 1 || line > hd44780->rows || col + width > hd44780->cols)
+        return false;
+
+    int pixels = _bar_pixels(value, max, width, 5);
+
+    for (int i = 0; i < width; ++i)
+        hd44780_frame_set(hd44780, line, col + i, _bar_cell(hd44780, pixels - i * 5, false));
+
+    if (render)
+        return (hd44780_commit(hd44780) >= 0);
+
+    return true;
+}
+
+/*!
+	@brief  Vertical bar growing up, 8 pixels per cell
+	@param  line  bottom row 1-4
+	@param  col  column
+	@param  height  number of cells
+	@param  value  0 to max
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_vbar(HD44780 *hd44780, uint8_t line, uint8_t col, uint8_t height,
+                  int value, int max, bool render)
+{
+    if (line < 1 || line > hd44780->rows || height > line || col >= hd44780->cols)
+        return false;
+
+    int pixels = _bar_pixels(value, max, height, 8);
+
+    for (int i = 0; i < height; ++i)
+        hd44780_frame_set(hd44780, line - i, col, _bar_cell(hd44780, pixels - i * 8, true));
+
+    if (render)
+        return (hd44780_commit(hd44780) >= 0);
+
+    return true;
+}
+
+static uint8_t _bar_glyph(HD44780 *hd44780, bool top, bool bottom)
+{
+    static const uint8_t glyph_top[8] = {0x1f, 0x1f, 0x1f, 0, 0, 0, 0, 0};
+    static const uint8_t glyph_bottom[8] = {0, 0, 0, 0, 0, 0x1f, 0x1f, 0x1f};
+    static const uint8_t glyph_both[8] = {0x1f, 0x1f, 0x1f, 0, 0, 0x1f, 0x1f, 0x1f};
+
+    if (top && bottom)
+        return _glyph_code(hd44780, glyph_both, '=');
+
+    if (top)
+        return _glyph_code(hd44780, glyph_top, '-');
+
+    if (bottom)
+        return _glyph_code(hd44780, glyph_bottom, '_');
+
+    return LCDCharSpace;
+}
+
+static uint8_t _big_cell(HD44780 *hd44780, uint8_t segs, uint8_t vertical,
+                         const BigRow *row)
+{
+    if (segs & vertical)
+        return LCDCharBlock;
+
+    return _bar_glyph(hd44780, segs & row->top, segs & row->bottom);
+}
+
+/*!
+	@brief  Big character, 3 columns wide and 2 or 4 rows high
+	@param  line  top row 1-4
+	@param  col  first column
+	@param  c  '0'-'9', '-' or ' '
+	@param  rows  2 or 4
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_big_char(HD44780 *hd44780, uint8_t line, uint8_t col,
+                      char c, int rows, bool render)
+{
+    if ((rows != 2 && rows != 4) || line < 1 || line + rows - 1 > hd44780->rows
+        || col + 3 > hd44780->cols)
+        return false;
+
+    uint8_t segs = 0;
+
+    if (c >= '0' && c <= '9')
+        segs = _segments[c - '0'];
+    else if (c == '-')
+        segs = SEG_G;
+
+    const BigRow *table = (rows == 2) ? _rows2 : _rows4;
+
+    for (int r = 0; r < rows; ++r)
+    {
+        const BigRow *row = &table[r];
+
+        hd44780_frame_set(hd44780, line + r, col, _big_cell(hd44780, segs, row->left, row));
+        hd44780_frame_set(hd44780, line + r, col + 1, _big_cell(hd44780, segs, 0, row));
+        hd44780_frame_set(hd44780, line + r, col + 2, _big_cell(hd44780, segs, row->right, row));
+    }
+
+    if (render)
+        return (hd44780_commit(hd44780) >= 0);
+
+    return true;
+}
+
+/*!
+	@brief  Big characters separated by a blank column, clipped at the end of the line
+	@param  line  top row 1-4
+	@param  col  first column
+	@param  str  '0'-'9', '-' or ' '
+	@param  rows  2 or 4
+	@param  render  commit the frame
+	@return false on error
+*/
+bool hd44780_big_string(HD44780 *hd44780, uint8_t line, uint8_t col,
+                        const char *str, int rows, bool render)
+{
+    if (str == NULL)
+        return false;
+
+    for ( ; *str && col + 3 <= hd44780->cols; col += HD44780_BIGDIGIT_WIDTH)
+    {
+        if (!hd44780_big_char(hd44780, line, col, *str++, rows, false))
+            return false;
+
+        if (col + 3 < hd44780->cols)
+        {
+            for (int r = 0; r < rows; ++r)
+                hd44780_frame_set(hd44780, line + r, col + 3, LCDCharSpace);
+        }
+    }
+
+    if (render)
+        return (hd44780_commit(hd44780) >= 0);
+
+    return true;
+}
+
@@ -0,0 +1,23 @@
+#ifndef __HD44780_WIDGET_H__
+#define __HD44780_WIDGET_H__
+
+#include <hd44780.h>
+
+// widgets draw into the pending frame with custom characters from the
+// CGRAM cache, with render they are committed right away, otherwise
+// several widgets can be drawn and sent by one hd44780_commit()
+
+#define HD44780_BIGDIGIT_WIDTH 4    // 3 columns and a space
+
+bool hd44780_hbar(HD44780 *hd44780, uint8_t line, uint8_t col, uint8_t width,
+                  int value, int max, bool render);
+bool hd44780_vbar(HD44780 *hd44780, uint8_t line, uint8_t col, uint8_t height,
+                  int value, int max, bool render);
+
+bool hd44780_big_char(HD44780 *hd44780, uint8_t line, uint8_t col,
+                      char c, int rows, bool render);
+bool hd44780_big_string(HD44780 *hd44780, uint8_t line, uint8_t col,
+                        const char *str, int rows, bool render);
+
+#endif
+
@@ -9,13 +9,20 @@ PKGCONFIG += tinyc
 
 HEADERS = \
     hd44780.h \
+    hd44780_layout.h \
+    hd44780_sim.h \
+    hd44780_widget.h \
 
 SOURCES = \
     0temp.c \
     main.c \
     hd44780.c \
+    hd44780_layout.c \
+    hd44780_sim.c \
+    hd44780_widget.c \
 
 DISTFILES = \
+    hd44780_bench.c \
     install.sh \
     License.txt \
     meson.build \
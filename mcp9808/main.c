@@ -5,7 +5,7 @@
 // cbuild build/test main.c && ./build/test
 // (gcc -Wall -Wextra -O2 -D_GNU_SOURCE -o build/test main.c)
 
-#include "mcp9808.h"
+#include "mcp9808_sampler.h"
 #include <stdlib.h>
 
 int main()
@@ -18,17 +18,36 @@ int main()
         return EXIT_FAILURE;
     }
 
-    float temp_c = 0;
+    MCP9808Sampler sampler;
 
-    while (1)
+    if (!mcp9808_sampler_init(&sampler)
+        || mcp9808_sampler_add(&sampler, &mcp9808) < 0)
     {
-        sleep(1);
+        printf("failed to start the sampler...\n");
+        return EXIT_FAILURE;
+    }
 
-        mcp9808_read(&mcp9808, &temp_c);
+    MCP9808Sample samples[MCP9808_RING_SIZE];
 
-        printf("temp = %.2f °C\n", temp_c);
+    while (1)
+    {
+        // a reading every conversion time, 250 ms at full resolution
+        if (mcp9808_sampler_poll(&sampler, -1) < 0)
+            break;
+
+        int count = mcp9808_sampler_read(&sampler, 0, samples, MCP9808_RING_SIZE);
+
+        for (int i = 0; i < count; ++i)
+        {
+            printf("%llu.%03llu temp = %.2f °C\n",
+                   (unsigned long long) (samples[i].time_ns / 1000000000ULL),
+                   (unsigned long long) (samples[i].time_ns / 1000000ULL % 1000),
+                   samples[i].value * 0.0625);
+        }
     }
 
+    mcp9808_sampler_close(&sampler);
+
     return EXIT_SUCCESS;
 }
 
@@ -1,63 +1,383 @@
 #include "mcp9808.h"
 
+#include <errno.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+// conversion time of each resolution
+static const uint32_t _conversion_ms[4] = {30, 65, 130, 250};
+
+static uint64_t _mcp9808_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void _mcp9808_sleep_until(uint64_t time_ns)
+{
+    struct timespec ts;
+    ts.tv_sec = time_ns / 1000000000ULL;
+    ts.tv_nsec = time_ns % 1000000000ULL;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+static void _mcp9808_conversion_start(MCP9808 *mcp9808)
+{
+    mcp9808->ready_ns = _mcp9808_time_ns()
+                        + _conversion_ms[mcp9808->resolution] * 1000000ULL;
+}
+
 bool mcp9808_init(MCP9808 *mcp9808, int channel, uint8_t addr)
 {
     mcp9808->addr = addr;
+    mcp9808->resolution = MCP9808_RES_0_0625;
+    mcp9808->shutdown = false;
     mcp9808->file = i2c_init(channel, addr);
 
     if (mcp9808->file < 0)
         return false;
 
-    // select configuration register(0x01)
-    // continuous conversion mode, power-up default (0x00, 0x00)
-    char config[3] = {0};
-    config[0] = 0x01;
-    config[1] = 0x00;
-    config[2] = 0x00;
-    write(mcp9808->file, config, 3);
+    // continuous conversion mode, power-up default
+    if (!mcp9808_write_reg16(mcp9808, MCP9808_REG_CONFIG, 0x0000))
+        return false;
 
-    // select resolution register (0x08)
     // resolution = +0.0625 / C (0x03)
-    config[0] = 0x08;
-    config[1] = 0x03;
-    write(mcp9808->file, config, 2);
+    if (!mcp9808_set_resolution(mcp9808, MCP9808_RES_0_0625))
+        return false;
 
     return true;
 }
 
-bool mcp9808_read(MCP9808 *mcp9808, float *result)
+bool mcp9808_read_sixteenths(MCP9808 *mcp9808, int16_t *value, uint8_t *flags)
 {
-    if (!mcp9808 || mcp9808->file < 0 || !result)
+    if (!mcp9808 || mcp9808->file < 0 || !value)
         return false;
 
-    // read 2 bytes of data from register(0x05)
-    // temp msb, temp lsb
-
-    char reg[1] = {0x05};
-    write(mcp9808->file, reg, 1);
-
-    char data[2] = {0};
+    uint16_t raw;
 
-    if (read(mcp9808->file, data, 2) != 2)
+    if (!mcp9808_read_raw(mcp9808, &raw))
     {
         printf("Error : Input/Output error \n");
         return false;
     }
 
-    // Convert the data to 13-bits
-    int temp = ((data[0] & 0x1F) * 256 + data[1]);
-    if (temp > 4095)
+    *value = mcp9808_sixteenths(raw);
+
+    if (flags)
+        *flags = mcp9808_flags(raw);
+
+    return true;
+}
+
+bool mcp9808_read_millic(MCP9808 *mcp9808, int32_t *value, uint8_t *flags)
+{
+    int16_t sixteenths;
+
+    if (!value || !mcp9808_read_sixteenths(mcp9808, &sixteenths, flags))
+        return false;
+
+    *value = sixteenths * 125 / 2;
+
+    return true;
+}
+
+#ifndef MCP9808_NO_FLOAT
+bool mcp9808_read(MCP9808 *mcp9808, float *result)
+{
+    int16_t sixteenths;
+
+    if (!result || !mcp9808_read_sixteenths(mcp9808, &sixteenths, NULL))
+        return false;
+
+    float temp_c = sixteenths * 0.0625f;
+    *result = temp_c;
+
+    return true;
+}
+#endif
+
+int16_t mcp9808_sixteenths(uint16_t raw)
+{
+    // 13 bits two's complement, the upper 3 bits are the alert flags,
+    // bit 12 is the sign, worth -4096
+
+    return (raw & 0x0FFF) - (raw & 0x1000);
+}
+
+int32_t mcp9808_millic(uint16_t raw)
+{
+    // 1/16 C is 62.5 mC
+
+    return mcp9808_sixteenths(raw) * 125 / 2;
+}
+
+uint8_t mcp9808_flags(uint16_t raw)
+{
+    return raw >> 13;
+}
+
+void mcp9808_convert(const uint16_t *raw, int32_t *millic, uint8_t *flags, int count)
+{
+    for (int i = 0; i < count; ++i)
     {
-        temp -= 8192;
+        int32_t value = (raw[i] & 0x0FFF) - (raw[i] & 0x1000);
+        millic[i] = value * 125 / 2;
     }
 
-    if (!result)
+    if (flags == NULL)
+        return;
+
+    for (int i = 0; i < count; ++i)
+        flags[i] = raw[i] >> 13;
+}
+
+bool mcp9808_read_reg(MCP9808 *mcp9808, uint8_t reg, uint8_t *data, int len)
+{
+    // pointer write, repeated start, data read
+
+    struct i2c_msg msgs[2] =
+    {
+        {mcp9808->addr, 0, 1, &reg},
+        {mcp9808->addr, I2C_M_RD, len, data},
+    };
+
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = 2;
+
+    return (ioctl(mcp9808->file, I2C_RDWR, &rdwr) == 2);
+}
+
+bool mcp9808_read_reg8(MCP9808 *mcp9808, uint8_t reg, uint8_t *value)
+{
+    return mcp9808_read_reg(mcp9808, reg, value, 1);
+}
+
+bool mcp9808_read_reg16(MCP9808 *mcp9808, uint8_t reg, uint16_t *value)
+{
+    uint8_t data[2];
+
+    if (!mcp9808_read_reg(mcp9808, reg, data, 2))
         return false;
 
-    float temp_c = temp * 0.0625;
-    *result = temp_c;
+    *value = (data[0] << 8) | data[1];
+
+    return true;
+}
+
+static bool _mcp9808_write(MCP9808 *mcp9808, uint8_t *data, int len)
+{
+    // addressed by the message, not by the I2C_SLAVE of the fd,
+    // the sensors of a group share one fd
+
+    struct i2c_msg msg = {mcp9808->addr, 0, len, data};
+
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = &msg;
+    rdwr.nmsgs = 1;
+
+    return (ioctl(mcp9808->file, I2C_RDWR, &rdwr) == 1);
+}
+
+bool mcp9808_write_reg8(MCP9808 *mcp9808, uint8_t reg, uint8_t value)
+{
+    uint8_t data[2] = {reg, value};
+
+    return _mcp9808_write(mcp9808, data, 2);
+}
+
+bool mcp9808_write_reg16(MCP9808 *mcp9808, uint8_t reg, uint16_t value)
+{
+    uint8_t data[3] = {reg, value >> 8, value & 0xff};
+
+    return _mcp9808_write(mcp9808, data, 3);
+}
+
+bool mcp9808_read_raw(MCP9808 *mcp9808, uint16_t *raw)
+{
+    return mcp9808_read_reg16(mcp9808, MCP9808_REG_TEMP, raw);
+}
+
+bool mcp9808_read_id(MCP9808 *mcp9808, uint16_t *manufacturer, uint16_t *device)
+{
+    // both pointer writes and reads in one transfer
+
+    uint8_t reg_manuf = MCP9808_REG_MANUF_ID;
+    uint8_t reg_device = MCP9808_REG_DEVICE_ID;
+    uint8_t data[4];
+
+    struct i2c_msg msgs[4] =
+    {
+        {mcp9808->addr, 0, 1, &reg_manuf},
+        {mcp9808->addr, I2C_M_RD, 2, &data[0]},
+        {mcp9808->addr, 0, 1, &reg_device},
+        {mcp9808->addr, I2C_M_RD, 2, &data[2]},
+    };
+
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = 4;
+
+    if (ioctl(mcp9808->file, I2C_RDWR, &rdwr) != 4)
+        return false;
+
+    *manufacturer = (data[0] << 8) | data[1];
+    *device = (data[2] << 8) | data[3];
+
+    return true;
+}
+
+static uint16_t _mcp9808_limit(int16_t value)
+{
+    // 0.25 C steps in bits 12-2, same layout as the temperature
+
+    return (uint16_t) value & 0x1FFC;
+}
+
+bool mcp9808_set_limits(MCP9808 *mcp9808, int16_t lower, int16_t upper, int16_t crit)
+{
+    return (mcp9808_write_reg16(mcp9808, MCP9808_REG_LOWER, _mcp9808_limit(lower))
+            && mcp9808_write_reg16(mcp9808, MCP9808_REG_UPPER, _mcp9808_limit(upper))
+            && mcp9808_write_reg16(mcp9808, MCP9808_REG_CRIT, _mcp9808_limit(crit)));
+}
+
+bool mcp9808_get_limits(MCP9808 *mcp9808, int16_t *lower, int16_t *upper, int16_t *crit)
+{
+    uint16_t reg[3];
+
+    if (!mcp9808_read_reg16(mcp9808, MCP9808_REG_LOWER, &reg[0])
+        || !mcp9808_read_reg16(mcp9808, MCP9808_REG_UPPER, &reg[1])
+        || !mcp9808_read_reg16(mcp9808, MCP9808_REG_CRIT, &reg[2]))
+        return false;
+
+    *lower = mcp9808_sixteenths(reg[0]);
+    *upper = mcp9808_sixteenths(reg[1]);
+    *crit = mcp9808_sixteenths(reg[2]);
+
+    return true;
+}
+
+static bool _mcp9808_update_config(MCP9808 *mcp9808, uint16_t mask, uint16_t value)
+{
+    uint16_t config;
+
+    if (!mcp9808_read_reg16(mcp9808, MCP9808_REG_CONFIG, &config))
+        return false;
+
+    // status and clear bits are not kept
+    config &= ~(mask | MCP9808_CONFIG_INT_CLEAR | MCP9808_CONFIG_ALERT_STAT);
+    config |= value & mask;
+
+    return mcp9808_write_reg16(mcp9808, MCP9808_REG_CONFIG, config);
+}
+
+bool mcp9808_set_alert(MCP9808 *mcp9808, int mode, bool crit_only,
+                       bool active_high, int hysteresis)
+{
+    uint16_t mask = MCP9808_CONFIG_HYST | MCP9808_CONFIG_ALERT_CNT
+                    | MCP9808_CONFIG_ALERT_SEL | MCP9808_CONFIG_ALERT_POL
+                    | MCP9808_CONFIG_ALERT_MOD;
+
+    uint16_t value = ((hysteresis & 0x03) << 9) | MCP9808_CONFIG_ALERT_CNT;
+
+    if (crit_only)
+        value |= MCP9808_CONFIG_ALERT_SEL;
+
+    if (active_high)
+        value |= MCP9808_CONFIG_ALERT_POL;
+
+    if (mode == MCP9808_ALERT_INTERRUPT)
+        value |= MCP9808_CONFIG_ALERT_MOD;
+
+    return _mcp9808_update_config(mcp9808, mask, value);
+}
+
+bool mcp9808_disable_alert(MCP9808 *mcp9808)
+{
+    return _mcp9808_update_config(mcp9808, MCP9808_CONFIG_ALERT_CNT, 0);
+}
+
+bool mcp9808_clear_alert(MCP9808 *mcp9808)
+{
+    return _mcp9808_update_config(mcp9808, MCP9808_CONFIG_INT_CLEAR,
+                                  MCP9808_CONFIG_INT_CLEAR);
+}
+
+uint32_t mcp9808_conversion_ms(int resolution)
+{
+    return _conversion_ms[resolution & 0x03];
+}
+
+bool mcp9808_set_resolution(MCP9808 *mcp9808, int resolution)
+{
+    if (!mcp9808_write_reg8(mcp9808, MCP9808_REG_RESOLUTION, resolution & 0x03))
+        return false;
+
+    // the conversion in progress may use the previous resolution
+    mcp9808->resolution = resolution & 0x03;
+    _mcp9808_conversion_start(mcp9808);
 
     return true;
 }
 
+bool mcp9808_set_shutdown(MCP9808 *mcp9808, bool shutdown)
+{
+    if (!_mcp9808_update_config(mcp9808, MCP9808_CONFIG_SHDN,
+                                shutdown ? MCP9808_CONFIG_SHDN : 0))
+        return false;
+
+    mcp9808->shutdown = shutdown;
 
+    if (!shutdown)
+        _mcp9808_conversion_start(mcp9808);
+
+    return true;
+}
+
+bool mcp9808_read_oneshot(MCP9808 *mcp9808, uint16_t *raw)
+{
+    if (!mcp9808_set_shutdown(mcp9808, false))
+        return false;
+
+    _mcp9808_sleep_until(mcp9808->ready_ns);
+
+    if (!mcp9808_read_raw(mcp9808, raw))
+        return false;
+
+    // the sample is good even if the sensor can't be shut down again,
+    // it keeps converting, mcp9808->shutdown stays false and the next
+    // one-shot read tries again
+    if (!mcp9808_set_shutdown(mcp9808, true))
+        _mcp9808_conversion_start(mcp9808);
+
+    return true;
+}
+
+int mcp9808_read_new(MCP9808 *mcp9808, uint16_t *raw, bool wait)
+{
+    if (mcp9808->shutdown)
+        return mcp9808_read_oneshot(mcp9808, raw) ? 1 : -1;
+
+    if (_mcp9808_time_ns() < mcp9808->ready_ns)
+    {
+        if (!wait)
+            return 0;
+
+        _mcp9808_sleep_until(mcp9808->ready_ns);
+    }
+
+    if (!mcp9808_read_raw(mcp9808, raw))
+        return -1;
+
+    // the conversions run freely, a full one is done a period later
+    _mcp9808_conversion_start(mcp9808);
+
+    return 1;
+}
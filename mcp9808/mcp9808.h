@@ -5,15 +5,134 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// registers, 16 bits MSB first except the resolution
+#define MCP9808_REG_CONFIG      0x01
+#define MCP9808_REG_UPPER       0x02
+#define MCP9808_REG_LOWER       0x03
+#define MCP9808_REG_CRIT        0x04
+#define MCP9808_REG_TEMP        0x05
+#define MCP9808_REG_MANUF_ID    0x06
+#define MCP9808_REG_DEVICE_ID   0x07
+#define MCP9808_REG_RESOLUTION  0x08
+
+// alert flags of the temperature register, bits 15-13
+#define MCP9808_FLAG_CRIT       0x04    // T_A >= T_CRIT
+#define MCP9808_FLAG_UPPER      0x02    // T_A > T_UPPER
+#define MCP9808_FLAG_LOWER      0x01    // T_A < T_LOWER
+
+#define MCP9808_MANUF_ID        0x0054
+#define MCP9808_DEVICE_ID       0x04    // upper byte, the lower is the revision
+
+// configuration register
+#define MCP9808_CONFIG_HYST       0x0600  // limit hysteresis, see below
+#define MCP9808_CONFIG_SHDN       0x0100  // shutdown
+#define MCP9808_CONFIG_CRIT_LOCK  0x0080  // T_CRIT locked until power off
+#define MCP9808_CONFIG_WIN_LOCK   0x0040  // T_UPPER and T_LOWER locked
+#define MCP9808_CONFIG_INT_CLEAR  0x0020  // clear the interrupt, reads 0
+#define MCP9808_CONFIG_ALERT_STAT 0x0010  // alert output asserted
+#define MCP9808_CONFIG_ALERT_CNT  0x0008  // alert output enabled
+#define MCP9808_CONFIG_ALERT_SEL  0x0004  // alert on T_CRIT only
+#define MCP9808_CONFIG_ALERT_POL  0x0002  // alert active high
+#define MCP9808_CONFIG_ALERT_MOD  0x0001  // interrupt mode, comparator if 0
+
+enum
+{
+    MCP9808_HYST_0 = 0,     // 0 C
+    MCP9808_HYST_1_5,       // +1.5 C
+    MCP9808_HYST_3,         // +3 C
+    MCP9808_HYST_6          // +6 C
+};
+
+enum
+{
+    MCP9808_ALERT_COMPARATOR = 0,   // asserted while out of the limits
+    MCP9808_ALERT_INTERRUPT         // asserted on a crossing until cleared
+};
+
+enum
+{
+    MCP9808_RES_0_5 = 0,    // 0.5 C, 30 ms
+    MCP9808_RES_0_25,       // 0.25 C, 65 ms
+    MCP9808_RES_0_125,      // 0.125 C, 130 ms
+    MCP9808_RES_0_0625      // 0.0625 C, 250 ms, power-up default
+};
+
 typedef struct mcp9808
 {
     int file;
     uint8_t addr;
 
+    uint8_t resolution;
+    bool shutdown;
+    uint64_t ready_ns;      // CLOCK_MONOTONIC time of the next new conversion
+
 } MCP9808;
 
 bool mcp9808_init(MCP9808 *mcp9808, int channel, uint8_t addr);
+
+// temperature in 1/16 C or milli-degrees C with the alert flags,
+// flags may be NULL
+bool mcp9808_read_sixteenths(MCP9808 *mcp9808, int16_t *value, uint8_t *flags);
+bool mcp9808_read_millic(MCP9808 *mcp9808, int32_t *value, uint8_t *flags);
+
+#ifndef MCP9808_NO_FLOAT
+// degrees C, built on mcp9808_read_sixteenths()
 bool mcp9808_read(MCP9808 *mcp9808, float *result);
+#endif
+
+// register access, the pointer write and the data read are one
+// I2C_RDWR transfer with a repeated start, writes are an I2C_RDWR
+// message too, every access goes to mcp9808->addr
+bool mcp9808_read_reg(MCP9808 *mcp9808, uint8_t reg, uint8_t *data, int len);
+bool mcp9808_read_reg8(MCP9808 *mcp9808, uint8_t reg, uint8_t *value);
+bool mcp9808_read_reg16(MCP9808 *mcp9808, uint8_t reg, uint16_t *value);
+bool mcp9808_write_reg8(MCP9808 *mcp9808, uint8_t reg, uint8_t value);
+bool mcp9808_write_reg16(MCP9808 *mcp9808, uint8_t reg, uint16_t value);
+
+// temperature register as read, flags in the upper 3 bits
+bool mcp9808_read_raw(MCP9808 *mcp9808, uint16_t *raw);
+
+// conversions of the register value, milli-degrees are truncated
+int16_t mcp9808_sixteenths(uint16_t raw);
+int32_t mcp9808_millic(uint16_t raw);
+uint8_t mcp9808_flags(uint16_t raw);
+
+// register values to milli-degrees C and flags in one pass, flags may
+// be NULL, the loops have no branch so they can be vectorized
+void mcp9808_convert(const uint16_t *raw, int32_t *millic, uint8_t *flags, int count);
+
+// manufacturer and device ID in one transfer
+bool mcp9808_read_id(MCP9808 *mcp9808, uint16_t *manufacturer, uint16_t *device);
+
+// resolution and its conversion time, at most one new reading
+// per conversion time
+bool mcp9808_set_resolution(MCP9808 *mcp9808, int resolution);
+uint32_t mcp9808_conversion_ms(int resolution);
+
+// shutdown stops the conversions, the limits can't be locked
+bool mcp9808_set_shutdown(MCP9808 *mcp9808, bool shutdown);
+
+// wake from shutdown, wait one conversion, read and shutdown again,
+// returns the read result, mcp9808->shutdown is false if the sensor
+// couldn't be shut down again
+bool mcp9808_read_oneshot(MCP9808 *mcp9808, uint16_t *raw);
+
+// read only once a conversion completed since the last read, sleeps
+// until then with wait, returns 1 if read, 0 if not ready, -1 on error
+int mcp9808_read_new(MCP9808 *mcp9808, uint16_t *raw, bool wait);
+
+// limits in 1/16 C, rounded down to the 0.25 C of the registers,
+// the ALERT output is asserted above upper or crit and below lower
+bool mcp9808_set_limits(MCP9808 *mcp9808, int16_t lower, int16_t upper, int16_t crit);
+bool mcp9808_get_limits(MCP9808 *mcp9808, int16_t *lower, int16_t *upper, int16_t *crit);
+
+// ALERT output, mode MCP9808_ALERT_*, hysteresis MCP9808_HYST_*
+bool mcp9808_set_alert(MCP9808 *mcp9808, int mode, bool crit_only,
+                       bool active_high, int hysteresis);
+bool mcp9808_disable_alert(MCP9808 *mcp9808);
+
+// release the output in interrupt mode
+bool mcp9808_clear_alert(MCP9808 *mcp9808);
 
 #endif // MCP9808_H
 
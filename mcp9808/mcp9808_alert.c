@@ -0,0 +1,134 @@
+#include "mcp9808_alert.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+bool mcp9808_alert_open(MCP9808Alert *alert, MCP9808 *mcp9808,
+                        int gpiochip, int line)
+{
+    alert->mcp9808 = mcp9808;
+    alert->fd = -1;
+    alert->events = 0;
+
+    uint16_t config;
+
+    if (!mcp9808_read_reg16(mcp9808, MCP9808_REG_CONFIG, &config))
+        return false;
+
+    alert->interrupt = config & MCP9808_CONFIG_ALERT_MOD;
+    alert->active_high = config & MCP9808_CONFIG_ALERT_POL;
+
+    char filepath[32];
+    snprintf(filepath, sizeof(filepath), "/dev/gpiochip%d", gpiochip);
+
+    int chip = open(filepath, O_RDWR | O_CLOEXEC);
+
+    if (chip < 0)
+    {
+        fprintf(stderr, "Unable to open %s\n", filepath);
+        return false;
+    }
+
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof(request));
+
+    request.offsets[0] = line;
+    request.num_lines = 1;
+
+    strcpy(request.consumer, "mcp9808");
+
+    // comparator mode reports entering and leaving the limits,
+    // interrupt mode only the assertion, the output is open drain
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+
+    if (!alert->interrupt)
+        request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    else if (alert->active_high)
+        request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    else
+        request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+    if (!alert->active_high)
+        request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+
+    int result = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &request);
+
+    close(chip);
+
+    if (result < 0)
+    {
+        fprintf(stderr, "Unable to request gpio line %d\n", line);
+        return false;
+    }
+
+    alert->fd = request.fd;
+
+    return true;
+}
+
+void mcp9808_alert_close(MCP9808Alert *alert)
+{
+    if (alert->fd != -1)
+        close(alert->fd);
+
+    alert->fd = -1;
+}
+
+int mcp9808_alert_active(MCP9808Alert *alert)
+{
+    struct gpio_v2_line_values values;
+    values.mask = 1;
+    values.bits = 0;
+
+    if (ioctl(alert->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+        return -1;
+
+    bool high = values.bits & 1;
+
+    return (high == alert->active_high);
+}
+
+int mcp9808_alert_handle(MCP9808Alert *alert, uint16_t *raw)
+{
+    struct gpio_v2_line_event events[16];
+
+    ssize_t len = read(alert->fd, events, sizeof(events));
+
+    if (len < (ssize_t) sizeof(events[0]))
+        return -1;
+
+    alert->events += len / sizeof(events[0]);
+
+    if (!mcp9808_read_raw(alert->mcp9808, raw))
+        return -1;
+
+    // the output stays asserted until cleared in interrupt mode
+    if (alert->interrupt && !mcp9808_clear_alert(alert->mcp9808))
+        return -1;
+
+    return 1;
+}
+
+int mcp9808_alert_wait(MCP9808Alert *alert, int timeout, uint16_t *raw)
+{
+    struct pollfd pfd;
+    pfd.fd = alert->fd;
+    pfd.events = POLLIN;
+
+    int n = poll(&pfd, 1, timeout);
+
+    if (n < 0)
+        return (errno == EINTR) ? 0 : -1;
+
+    if (n == 0)
+        return 0;
+
+    return mcp9808_alert_handle(alert, raw);
+}
+
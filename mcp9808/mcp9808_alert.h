@@ -0,0 +1,39 @@
+#ifndef MCP9808_ALERT_H
+#define MCP9808_ALERT_H
+
+#include "mcp9808.h"
+
+// ALERT output on a gpiochip line, the temperature is only read when
+// a limit is crossed, the line fd can go in an epoll loop or be
+// waited on with mcp9808_alert_wait()
+
+typedef struct mcp9808_alert
+{
+    MCP9808 *mcp9808;   // owned by the caller
+    int fd;             // line request, readable on an event
+    bool interrupt;     // interrupt mode, cleared after each event
+    bool active_high;
+
+    unsigned long events;
+
+} MCP9808Alert;
+
+// request the line, mcp9808_set_alert() must be called before so the
+// edges match the mode and polarity of the output
+bool mcp9808_alert_open(MCP9808Alert *alert, MCP9808 *mcp9808,
+                        int gpiochip, int line);
+void mcp9808_alert_close(MCP9808Alert *alert);
+
+// 1 if the output is asserted, 0 if not, -1 on error
+int mcp9808_alert_active(MCP9808Alert *alert);
+
+// once the fd is readable : drain the events, read the temperature
+// and clear the interrupt, returns 1 or -1 on error
+int mcp9808_alert_handle(MCP9808Alert *alert, uint16_t *raw);
+
+// wait up to timeout ms (-1 forever) for a crossing,
+// returns 1 with the temperature, 0 on timeout, -1 on error
+int mcp9808_alert_wait(MCP9808Alert *alert, int timeout, uint16_t *raw);
+
+#endif // MCP9808_ALERT_H
+
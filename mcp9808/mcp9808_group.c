@@ -0,0 +1,101 @@
+#include "mcp9808_group.h"
+
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+int mcp9808_group_scan(MCP9808Group *group, int channel)
+{
+    group->count = 0;
+    group->reg = MCP9808_REG_TEMP;
+
+    // reads and writes carry their address in the I2C_RDWR messages,
+    // the I2C_SLAVE of the fd is never used
+    group->file = i2c_init(channel, MCP9808_GROUP_FIRST);
+
+    if (group->file < 0)
+        return -1;
+
+    for (int i = 0; i < MCP9808_GROUP_MAX; ++i)
+    {
+        MCP9808 probe;
+        probe.file = group->file;
+        probe.addr = MCP9808_GROUP_FIRST + i;
+
+        uint16_t manufacturer;
+        uint16_t device;
+
+        // no answer or another device
+        if (!mcp9808_read_id(&probe, &manufacturer, &device)
+            || manufacturer != MCP9808_MANUF_ID
+            || (device >> 8) != MCP9808_DEVICE_ID)
+            continue;
+
+        int n = group->count++;
+        group->addr[n] = probe.addr;
+
+        struct i2c_msg *msgs = &group->msgs[n * 2];
+
+        msgs[0].addr = probe.addr;
+        msgs[0].flags = 0;
+        msgs[0].len = 1;
+        msgs[0].buf = &group->reg;
+
+        msgs[1].addr = probe.addr;
+        msgs[1].flags = I2C_M_RD;
+        msgs[1].len = 2;
+        msgs[1].buf = group->data[n];
+    }
+
+    return group->count;
+}
+
+void mcp9808_group_close(MCP9808Group *group)
+{
+    if (group->file != -1)
+        close(group->file);
+
+    group->file = -1;
+    group->count = 0;
+}
+
+bool mcp9808_group_read(MCP9808Group *group, uint16_t *raw)
+{
+    if (group->count == 0)
+        return false;
+
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = group->msgs;
+    rdwr.nmsgs = group->count * 2;
+
+    if (ioctl(group->file, I2C_RDWR, &rdwr) != (int) rdwr.nmsgs)
+        return false;
+
+    for (int i = 0; i < group->count; ++i)
+        raw[i] = (group->data[i][0] << 8) | group->data[i][1];
+
+    return true;
+}
+
+bool mcp9808_group_sensor(MCP9808Group *group, int index, MCP9808 *mcp9808)
+{
+    if (index < 0 || index >= group->count)
+        return false;
+
+    mcp9808->file = group->file;
+    mcp9808->addr = group->addr[index];
+    mcp9808->ready_ns = 0;
+
+    uint16_t config;
+    uint8_t resolution;
+
+    if (!mcp9808_read_reg16(mcp9808, MCP9808_REG_CONFIG, &config)
+        || !mcp9808_read_reg8(mcp9808, MCP9808_REG_RESOLUTION, &resolution))
+        return false;
+
+    mcp9808->shutdown = config & MCP9808_CONFIG_SHDN;
+    mcp9808->resolution = resolution & 0x03;
+
+    return true;
+}
+
@@ -0,0 +1,40 @@
+#ifndef MCP9808_GROUP_H
+#define MCP9808_GROUP_H
+
+#include "mcp9808.h"
+#include <linux/i2c.h>
+
+// the sensors of one bus on a single fd, found by their ID in the
+// 0x18-0x1F address range, all the temperatures are read by one
+// I2C_RDWR transfer, the messages point in the group so it can't be
+// copied once scanned
+
+#define MCP9808_GROUP_FIRST 0x18
+#define MCP9808_GROUP_MAX 8
+
+typedef struct mcp9808_group
+{
+    int file;
+    int count;
+    uint8_t addr[MCP9808_GROUP_MAX];
+
+    // pointer write and read of each sensor, built by the scan
+    uint8_t reg;
+    uint8_t data[MCP9808_GROUP_MAX][2];
+    struct i2c_msg msgs[MCP9808_GROUP_MAX * 2];
+
+} MCP9808Group;
+
+// probe the addresses, returns the number of sensors or -1
+int mcp9808_group_scan(MCP9808Group *group, int channel);
+void mcp9808_group_close(MCP9808Group *group);
+
+// temperature registers of all the sensors, in scan order, a sensor
+// that doesn't answer fails the whole transfer
+bool mcp9808_group_read(MCP9808Group *group, uint16_t *raw);
+
+// a sensor of the group for the single sensor calls, shares the fd
+bool mcp9808_group_sensor(MCP9808Group *group, int index, MCP9808 *mcp9808);
+
+#endif // MCP9808_GROUP_H
+
@@ -0,0 +1,167 @@
+#include "mcp9808_history.h"
+
+#include <string.h>
+
+#define NS_PER_MINUTE (60ULL * 1000000000ULL)
+
+static MCP9808Bucket* _history_ring(MCP9808History *history, int level, int *size)
+{
+    switch (level)
+    {
+    case MCP9808_HISTORY_MINUTE:
+        *size = MCP9808_HISTORY_MINUTES;
+        return history->minutes;
+
+    case MCP9808_HISTORY_HOUR:
+        *size = MCP9808_HISTORY_HOURS;
+        return history->hours;
+    }
+
+    *size = 0;
+    return NULL;
+}
+
+void mcp9808_history_init(MCP9808History *history)
+{
+    memset(history, 0, sizeof(MCP9808History));
+
+    history->levels[MCP9808_HISTORY_MINUTE].period_ns = NS_PER_MINUTE;
+    history->levels[MCP9808_HISTORY_HOUR].period_ns = 60 * NS_PER_MINUTE;
+}
+
+static void _history_level_add(MCP9808History *history, int index,
+                               uint64_t time_ns, int32_t value)
+{
+    MCP9808Level *level = &history->levels[index];
+    MCP9808Bucket *current = &level->current;
+
+    // a sample in a later period closes the open bucket
+    if (current->count > 0 && time_ns >= current->start_ns + level->period_ns)
+    {
+        int size;
+        MCP9808Bucket *ring = _history_ring(history, index, &size);
+
+        ring[level->head] = *current;
+        level->head = (level->head + 1) % size;
+
+        if (level->count < size)
+            level->count++;
+
+        current->count = 0;
+    }
+
+    if (current->count == 0)
+    {
+        current->start_ns = time_ns - time_ns % level->period_ns;
+        current->min = value;
+        current->max = value;
+        current->sum = 0;
+    }
+
+    if (value < current->min)
+        current->min = value;
+
+    if (value > current->max)
+        current->max = value;
+
+    current->sum += value;
+    current->count++;
+}
+
+void mcp9808_history_add(MCP9808History *history, uint64_t time_ns, int32_t value)
+{
+    MCP9808Point *point = &history->raw[history->raw_head];
+    point->time_ns = time_ns;
+    point->value = value;
+
+    history->raw_head = (history->raw_head + 1) % MCP9808_HISTORY_RAW;
+
+    if (history->raw_count < MCP9808_HISTORY_RAW)
+        history->raw_count++;
+
+    for (int i = 0; i < MCP9808_HISTORY_LEVELS; ++i)
+        _history_level_add(history, i, time_ns, value);
+
+    history->samples++;
+}
+
+int mcp9808_history_raw(MCP9808History *history, uint64_t from_ns, uint64_t to_ns,
+                        MCP9808Point *points, int max)
+{
+    // back from the newest to the first sample in range, then forward,
+    // recent ranges only look at the end of the ring
+
+    int size = MCP9808_HISTORY_RAW;
+    int oldest = (history->raw_head - history->raw_count + size) % size;
+    int first = history->raw_count;
+
+    while (first > 0 && history->raw[(oldest + first - 1) % size].time_ns >= from_ns)
+        first--;
+
+    int n = 0;
+
+    for (int k = first; k < history->raw_count && n < max; ++k)
+    {
+        const MCP9808Point *point = &history->raw[(oldest + k) % size];
+
+        if (point->time_ns >= to_ns)
+            break;
+
+        points[n++] = *point;
+    }
+
+    return n;
+}
+
+static bool _bucket_overlaps(const MCP9808Bucket *bucket, uint64_t period_ns,
+                             uint64_t from_ns, uint64_t to_ns)
+{
+    return (bucket->start_ns + period_ns > from_ns && bucket->start_ns < to_ns);
+}
+
+int mcp9808_history_query(MCP9808History *history, int level,
+                          uint64_t from_ns, uint64_t to_ns,
+                          MCP9808Bucket *buckets, int max)
+{
+    int size;
+    MCP9808Bucket *ring = _history_ring(history, level, &size);
+
+    if (ring == NULL)
+        return -1;
+
+    MCP9808Level *state = &history->levels[level];
+    uint64_t period = state->period_ns;
+
+    int oldest = (state->head - state->count + size) % size;
+    int first = state->count;
+
+    while (first > 0 && ring[(oldest + first - 1) % size].start_ns + period > from_ns)
+        first--;
+
+    int n = 0;
+
+    for (int k = first; k < state->count && n < max; ++k)
+    {
+        const MCP9808Bucket *bucket = &ring[(oldest + k) % size];
+
+        if (bucket->start_ns >= to_ns)
+            return n;
+
+        buckets[n++] = *bucket;
+    }
+
+    if (n < max && state->current.count > 0
+        && _bucket_overlaps(&state->current, period, from_ns, to_ns))
+        buckets[n++] = state->current;
+
+    return n;
+}
+
+int32_t mcp9808_bucket_mean(const MCP9808Bucket *bucket)
+{
+    if (bucket->count == 0)
+        return 0;
+
+    return bucket->sum / bucket->count;
+}
+
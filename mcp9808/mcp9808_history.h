@@ -0,0 +1,85 @@
+#ifndef MCP9808_HISTORY_H
+#define MCP9808_HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// history of one sensor in fixed memory : the last samples and
+// 1 minute and 1 hour buckets with min, max, sum and count, each
+// sample updates the open bucket of every level, a bucket goes in its
+// ring when a sample falls in the next period, so adding is O(1) and
+// nothing is allocated
+//
+// values are fixed point, milli-degrees from mcp9808_millic() for
+// example, times are CLOCK_MONOTONIC ns and must not go back, no
+// locking, feed it from the consumer side of the sampler
+
+#define MCP9808_HISTORY_RAW     512     // samples
+#define MCP9808_HISTORY_MINUTES 1440    // 24 hours
+#define MCP9808_HISTORY_HOURS   720     // 30 days
+
+enum
+{
+    MCP9808_HISTORY_MINUTE = 0,
+    MCP9808_HISTORY_HOUR,
+    MCP9808_HISTORY_LEVELS
+};
+
+typedef struct mcp9808_point
+{
+    uint64_t time_ns;
+    int32_t value;
+
+} MCP9808Point;
+
+typedef struct mcp9808_bucket
+{
+    uint64_t start_ns;  // start of the period
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint32_t count;
+
+} MCP9808Bucket;
+
+typedef struct mcp9808_level
+{
+    uint64_t period_ns;
+    int head;           // next write
+    int count;
+    MCP9808Bucket current;  // open bucket, count 0 if none
+
+} MCP9808Level;
+
+typedef struct mcp9808_history
+{
+    MCP9808Point raw[MCP9808_HISTORY_RAW];
+    int raw_head;
+    int raw_count;
+
+    MCP9808Level levels[MCP9808_HISTORY_LEVELS];
+    MCP9808Bucket minutes[MCP9808_HISTORY_MINUTES];
+    MCP9808Bucket hours[MCP9808_HISTORY_HOURS];
+
+    unsigned long samples;
+
+} MCP9808History;
+
+void mcp9808_history_init(MCP9808History *history);
+void mcp9808_history_add(MCP9808History *history, uint64_t time_ns, int32_t value);
+
+// samples with from <= time < to, oldest first, returns the count
+int mcp9808_history_raw(MCP9808History *history, uint64_t from_ns, uint64_t to_ns,
+                        MCP9808Point *points, int max);
+
+// buckets of a level overlapping from - to, oldest first, the open
+// bucket included, returns the count, continue from the end of the
+// last one to get more than max
+int mcp9808_history_query(MCP9808History *history, int level,
+                          uint64_t from_ns, uint64_t to_ns,
+                          MCP9808Bucket *buckets, int max);
+
+int32_t mcp9808_bucket_mean(const MCP9808Bucket *bucket);
+
+#endif // MCP9808_HISTORY_H
+
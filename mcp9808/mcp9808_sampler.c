@@ -0,0 +1,290 @@
+#include "mcp9808_sampler.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t _time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool mcp9808_sampler_init(MCP9808Sampler *sampler)
+{
+    memset(sampler, 0, sizeof(MCP9808Sampler));
+
+    sampler->epoll = epoll_create1(EPOLL_CLOEXEC);
+    sampler->wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (sampler->epoll < 0 || sampler->wake < 0)
+    {
+        mcp9808_sampler_close(sampler);
+        return false;
+    }
+
+    // index past the channels for the wake event
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = MCP9808_SAMPLER_MAX;
+
+    if (epoll_ctl(sampler->epoll, EPOLL_CTL_ADD, sampler->wake, &event) < 0)
+    {
+        mcp9808_sampler_close(sampler);
+        return false;
+    }
+
+    return true;
+}
+
+void mcp9808_sampler_close(MCP9808Sampler *sampler)
+{
+    mcp9808_sampler_stop(sampler);
+
+    for (int i = 0; i < sampler->count; ++i)
+    {
+        close(sampler->channels[i].timer);
+        sampler->channels[i].timer = -1;
+    }
+
+    sampler->count = 0;
+
+    if (sampler->wake >= 0)
+        close(sampler->wake);
+
+    if (sampler->epoll >= 0)
+        close(sampler->epoll);
+
+    sampler->wake = -1;
+    sampler->epoll = -1;
+}
+
+int mcp9808_sampler_add(MCP9808Sampler *sampler, MCP9808 *mcp9808)
+{
+    if (sampler->count >= MCP9808_SAMPLER_MAX || sampler->running)
+        return -1;
+
+    uint8_t resolution;
+
+    if (!mcp9808_read_reg8(mcp9808, MCP9808_REG_RESOLUTION, &resolution))
+        return -1;
+
+    int index = sampler->count;
+    MCP9808Channel *channel = &sampler->channels[index];
+
+    memset(channel, 0, sizeof(MCP9808Channel));
+    channel->mcp9808 = mcp9808;
+    channel->period_ms = mcp9808_conversion_ms(resolution);
+
+    channel->timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if (channel->timer < 0)
+        return -1;
+
+    // first reading after a full conversion
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = channel->period_ms / 1000;
+    spec.it_interval.tv_nsec = (channel->period_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = index;
+
+    if (timerfd_settime(channel->timer, 0, &spec, NULL) < 0
+        || epoll_ctl(sampler->epoll, EPOLL_CTL_ADD, channel->timer, &event) < 0)
+    {
+        close(channel->timer);
+        return -1;
+    }
+
+    sampler->count++;
+
+    return index;
+}
+
+static void _sampler_publish(MCP9808Channel *channel, const MCP9808Sample *sample)
+{
+    // latest, readers retry while the sequence is odd or changed
+
+    uint32_t seq = channel->seq;
+
+    __atomic_store_n(&channel->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    channel->latest = *sample;
+    __atomic_store_n(&channel->seq, seq + 2, __ATOMIC_RELEASE);
+
+    // ring, dropped when full so the consumer owns the unread slots
+
+    uint32_t head = channel->head;
+    uint32_t tail = __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= MCP9808_RING_SIZE)
+    {
+        channel->overruns++;
+        return;
+    }
+
+    channel->ring[head & (MCP9808_RING_SIZE - 1)] = *sample;
+    __atomic_store_n(&channel->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static bool _sampler_read(MCP9808Channel *channel)
+{
+    uint64_t expirations;
+
+    if (read(channel->timer, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return false;
+
+    if (expirations > 1)
+        channel->missed += expirations - 1;
+
+    uint16_t raw;
+
+    if (!mcp9808_read_raw(channel->mcp9808, &raw))
+    {
+        channel->errors++;
+        return false;
+    }
+
+    MCP9808Sample sample;
+    sample.time_ns = _time_ns();
+    sample.value = mcp9808_sixteenths(raw);
+    sample.flags = mcp9808_flags(raw);
+
+    _sampler_publish(channel, &sample);
+
+    return true;
+}
+
+int mcp9808_sampler_poll(MCP9808Sampler *sampler, int timeout)
+{
+    struct epoll_event events[MCP9808_SAMPLER_MAX + 1];
+
+    int n = epoll_wait(sampler->epoll, events, MCP9808_SAMPLER_MAX + 1, timeout);
+
+    if (n < 0)
+        return -1;
+
+    int count = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        uint32_t index = events[i].data.u32;
+
+        if (index >= (uint32_t) sampler->count)
+            continue;
+
+        if (_sampler_read(&sampler->channels[index]))
+            count++;
+    }
+
+    return count;
+}
+
+static void* _sampler_thread(void *arg)
+{
+    MCP9808Sampler *sampler = (MCP9808Sampler*) arg;
+
+    while (__atomic_load_n(&sampler->running, __ATOMIC_ACQUIRE))
+    {
+        mcp9808_sampler_poll(sampler, -1);
+    }
+
+    return NULL;
+}
+
+bool mcp9808_sampler_start(MCP9808Sampler *sampler)
+{
+    if (sampler->running)
+        return false;
+
+    sampler->running = true;
+
+    if (pthread_create(&sampler->thread, NULL, _sampler_thread, sampler) != 0)
+    {
+        sampler->running = false;
+        return false;
+    }
+
+    return true;
+}
+
+void mcp9808_sampler_stop(MCP9808Sampler *sampler)
+{
+    if (!sampler->running)
+        return;
+
+    __atomic_store_n(&sampler->running, false, __ATOMIC_RELEASE);
+
+    uint64_t one = 1;
+    if (write(sampler->wake, &one, sizeof(one)) != sizeof(one))
+        fprintf(stderr, "Error: sampler wake failed\n");
+
+    pthread_join(sampler->thread, NULL);
+
+    // clear the wake event for a later start
+    uint64_t value;
+    ssize_t ret = read(sampler->wake, &value, sizeof(value));
+    (void) ret;
+}
+
+bool mcp9808_sampler_latest(MCP9808Sampler *sampler, int index, MCP9808Sample *sample)
+{
+    if (index < 0 || index >= sampler->count)
+        return false;
+
+    MCP9808Channel *channel = &sampler->channels[index];
+
+    uint32_t before;
+    uint32_t after = 0;
+
+    do
+    {
+        before = __atomic_load_n(&channel->seq, __ATOMIC_ACQUIRE);
+
+        if (before & 1)
+            continue;
+
+        *sample = channel->latest;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&channel->seq, __ATOMIC_RELAXED);
+    }
+    while ((before & 1) || before != after);
+
+    // no reading yet
+    return (before != 0);
+}
+
+int mcp9808_sampler_read(MCP9808Sampler *sampler, int index,
+                         MCP9808Sample *samples, int max)
+{
+    if (index < 0 || index >= sampler->count || max < 0)
+        return -1;
+
+    MCP9808Channel *channel = &sampler->channels[index];
+
+    uint32_t tail = channel->tail;
+    uint32_t head = __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE);
+
+    int count = 0;
+
+    while (tail != head && count < max)
+    {
+        samples[count++] = channel->ring[tail & (MCP9808_RING_SIZE - 1)];
+        tail++;
+    }
+
+    __atomic_store_n(&channel->tail, tail, __ATOMIC_RELEASE);
+
+    return count;
+}
+
@@ -0,0 +1,77 @@
+#ifndef MCP9808_SAMPLER_H
+#define MCP9808_SAMPLER_H
+
+#include "mcp9808.h"
+#include <pthread.h>
+
+// continuous sampling of several sensors on one thread, each sensor
+// has a CLOCK_MONOTONIC timerfd at its conversion time and the
+// readings go in a single producer, single consumer ring, so the
+// consumer never blocks the sampler nor waits for it
+
+#define MCP9808_SAMPLER_MAX 8
+#define MCP9808_RING_SIZE 64    // power of 2
+
+typedef struct mcp9808_sample
+{
+    uint64_t time_ns;   // CLOCK_MONOTONIC at the end of the read
+    int16_t value;      // 1/16 C
+    uint8_t flags;      // MCP9808_FLAG_*
+
+} MCP9808Sample;
+
+typedef struct mcp9808_channel
+{
+    MCP9808 *mcp9808;   // owned by the caller
+    int timer;
+    uint32_t period_ms;
+
+    // ring, head is written by the sampler and tail by the consumer
+    uint32_t head;
+    uint32_t tail;
+    MCP9808Sample ring[MCP9808_RING_SIZE];
+
+    // last reading, sequence odd while it is written
+    uint32_t seq;
+    MCP9808Sample latest;
+
+    unsigned long errors;   // failed reads
+    unsigned long missed;   // timer expirations not serviced
+    unsigned long overruns; // samples dropped, the ring was full
+
+} MCP9808Channel;
+
+typedef struct mcp9808_sampler
+{
+    int epoll;
+    int wake;           // eventfd, stops the thread
+    int count;
+    MCP9808Channel channels[MCP9808_SAMPLER_MAX];
+
+    pthread_t thread;
+    bool running;
+
+} MCP9808Sampler;
+
+bool mcp9808_sampler_init(MCP9808Sampler *sampler);
+void mcp9808_sampler_close(MCP9808Sampler *sampler);
+
+// add a sensor sampled at the conversion time of its resolution,
+// returns the channel index or -1
+int mcp9808_sampler_add(MCP9808Sampler *sampler, MCP9808 *mcp9808);
+
+// wait up to timeout ms (-1 forever) and read the sensors that are due,
+// returns the number of samples taken or -1
+int mcp9808_sampler_poll(MCP9808Sampler *sampler, int timeout);
+
+// run the poll loop in a thread
+bool mcp9808_sampler_start(MCP9808Sampler *sampler);
+void mcp9808_sampler_stop(MCP9808Sampler *sampler);
+
+// consumer side, never blocks
+bool mcp9808_sampler_latest(MCP9808Sampler *sampler, int index, MCP9808Sample *sample);
+int mcp9808_sampler_read(MCP9808Sampler *sampler, int index,
+                         MCP9808Sample *samples, int max);
+
+#endif // MCP9808_SAMPLER_H
+
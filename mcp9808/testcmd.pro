@@ -8,12 +8,20 @@ PKGCONFIG =
 PKGCONFIG += tinyc
 
 HEADERS = \
-    mcp9808.h
+    mcp9808.h \
+    mcp9808_alert.h \
+    mcp9808_group.h \
+    mcp9808_history.h \
+    mcp9808_sampler.h \
 
 SOURCES = \
     0temp.c \
     main.c \
     mcp9808.c \
+    mcp9808_alert.c \
+    mcp9808_group.c \
+    mcp9808_history.c \
+    mcp9808_sampler.c \
 
 DISTFILES = \
     install.sh \
@@ -0,0 +1,221 @@
+// fontgen : build the stretched font tables of ss_oled
+//
+// FONT_12x16 and FONT_16x16 are the 6x8 and 8x8 fonts stretched to
+// double width and height (the 12x16 one is also smoothed), instead of
+// doing it for every character drawn, the glyphs are generated once at
+// build time, normal and inverted, with the top page first.
+//
+// usage : fontgen font_stretched.h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+
+#define SMALL_COUNT (int) (sizeof(ucSmallFont) / 5)
+#define NORMAL_COUNT (int) (sizeof(ucFont) / 7)
+
+static void _invert_bytes(uint8_t *data, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        *data = ~(*data);
+        data++;
+    }
+}
+
+static void _stretch_12x16(uint8_t c, int invert, uint8_t *out)
+{
+    // 6x8 stretched to 12x16 with smoothed diagonals
+
+    unsigned char temp[40];
+    unsigned char uc1, uc2, ucMask, *pDest;
+    int tx, ty;
+
+    temp[0] = 0; // first column is blank
+    memcpy(&temp[1], &ucSmallFont[(int) c * 5], 5);
+
+    if (invert)
+        _invert_bytes(temp, 6);
+
+    // Stretch the font to double width + double height
+    memset(&temp[6], 0, 24); // write 24 new bytes
+    for (tx=0; tx<6; tx++)
+    {
+        ucMask = 3;
+        pDest = &temp[6+tx*2];
+        uc1 = uc2 = 0;
+        c = temp[tx];
+        for (ty=0; ty<4; ty++)
+        {
+            if (c & (1 << ty)) // a bit is set
+                uc1 |= ucMask;
+            if (c & (1 << (ty + 4)))
+                uc2 |= ucMask;
+            ucMask <<= 2;
+        }
+        pDest[0] = uc1;
+        pDest[1] = uc1; // double width
+        pDest[12] = uc2;
+        pDest[13] = uc2;
+    }
+    // smooth the diagonal lines
+    for (tx=0; tx<5; tx++)
+    {
+        uint8_t c0, c1, ucMask2;
+        c0 = temp[tx];
+        c1 = temp[tx+1];
+        pDest = &temp[6+tx*2];
+        ucMask = 1;
+        ucMask2 = 2;
+        for (ty=0; ty<7; ty++)
+        {
+            if (((c0 & ucMask) && !(c1 & ucMask) && !(c0 & ucMask2) && (c1 & ucMask2)) || (!(c0 & ucMask) && (c1 & ucMask) && (c0 & ucMask2) && !(c1 & ucMask2)))
+            {
+                if (ty < 3) // top half
+                {
+                    pDest[1] |= (1 << ((ty * 2)+1));
+                    pDest[2] |= (1 << ((ty * 2)+1));
+                    pDest[1] |= (1 << ((ty+1) * 2));
+                    pDest[2] |= (1 << ((ty+1) * 2));
+                }
+                else if (ty == 3) // on the border
+                {
+                    pDest[1] |= 0x80; pDest[2] |= 0x80;
+                    pDest[13] |= 1; pDest[14] |= 1;
+                }
+                else // bottom half
+                {
+                    pDest[13] |= (1 << (2*(ty-4)+1));
+                    pDest[14] |= (1 << (2*(ty-4)+1));
+                    pDest[13] |= (1 << ((ty-3) * 2));
+                    pDest[14] |= (1 << ((ty-3) * 2));
+                }
+            }
+            else if (!(c0 & ucMask) && (c1 & ucMask) && (c0 & ucMask2) && !(c1 & ucMask2))
+            {
+                if (ty < 4) // top half
+                {
+                    pDest[1] |= (1 << ((ty * 2)+1));
+                    pDest[2] |= (1 << ((ty+1) * 2));
+                }
+                else
+                {
+                    pDest[13] |= (1 << (2*(ty-4)+1));
+                    pDest[14] |= (1 << ((ty-3) * 2));
+                }
+            }
+            ucMask <<= 1; ucMask2 <<= 1;
+        }
+    }
+
+    // top page then bottom page
+    memcpy(out, &temp[6], 24);
+}
+
+static void _stretch_16x16(uint8_t c, int invert, uint8_t *out)
+{
+    // 8x8 stretched to 16x16
+
+    unsigned char temp[40];
+    unsigned char uc1, uc2, ucMask, *pDest;
+    int tx, ty;
+
+    temp[0] = 0;
+    memcpy(&temp[1], &ucFont[(int) c * 7], 7);
+
+    if (invert)
+        _invert_bytes(temp, 8);
+
+    // Stretch the font to double width + double height
+    memset(&temp[8], 0, 32); // write 32 new bytes
+    for (tx=0; tx<8; tx++)
+    {
+        ucMask = 3;
+        pDest = &temp[8+tx*2];
+        uc1 = uc2 = 0;
+        c = temp[tx];
+        for (ty=0; ty<4; ty++)
+        {
+            if (c & (1 << ty)) // a bit is set
+                uc1 |= ucMask;
+            if (c & (1 << (ty + 4)))
+                uc2 |= ucMask;
+            ucMask <<= 2;
+        }
+        pDest[0] = uc1;
+        pDest[1] = uc1; // double width
+        pDest[16] = uc2;
+        pDest[17] = uc2;
+    }
+
+    // top page then bottom page
+    memcpy(out, &temp[8], 32);
+}
+
+static void _write_table(FILE *file, const char *name, int count, int size,
+                         void (*stretch)(uint8_t, int, uint8_t*))
+{
+    uint8_t glyph[32];
+
+    fprintf(file, "const uint8_t %s[2][%d][%d] =\n{\n", name, count, size);
+
+    for (int invert = 0; invert < 2; ++invert)
+    {
+        fprintf(file, "    {\n");
+
+        for (int c = 0; c < count; ++c)
+        {
+            stretch(c, invert, glyph);
+
+            fprintf(file, "        {");
+
+            for (int i = 0; i < size; ++i)
+                fprintf(file, "%s0x%02x", i ? "," : "", glyph[i]);
+
+            if (c + 32 < 127)
+                fprintf(file, "}, // '%c'\n", c + 32);
+            else
+                fprintf(file, "}, // 0x%02x\n", c + 32);
+        }
+
+        fprintf(file, "    },\n");
+    }
+
+    fprintf(file, "};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage : fontgen output.h\n");
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "w");
+
+    if (!file)
+    {
+        fprintf(stderr, "can't create %s\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(file, "// generated by fontgen, do not edit\n\n");
+    fprintf(file, "#ifndef FONT_STRETCHED_H\n#define FONT_STRETCHED_H\n\n");
+    fprintf(file, "#include <stdint.h>\n\n");
+
+    fprintf(file, "// 6x8 stretched to 12x16 and smoothed, [invert][char][page * 12 + col]\n");
+    _write_table(file, "ucFont12x16", SMALL_COUNT, 24, _stretch_12x16);
+
+    fprintf(file, "// 8x8 stretched to 16x16, [invert][char][page * 16 + col]\n");
+    _write_table(file, "ucFont16x16", NORMAL_COUNT, 32, _stretch_16x16);
+
+    fprintf(file, "#endif // FONT_STRETCHED_H\n\n");
+
+    fclose(file);
+
+    return 0;
+}
+
@@ -0,0 +1,335 @@
+// oled_bench : bus cost of the ss_oled primitives
+//
+// Every primitive is run on the in-memory bus with the controller
+// model attached, the bytes and messages are counted and the display
+// memory is checked against the back buffer afterwards.
+//
+// The bus time is estimated for I2C at 100, 400 and 1000 kHz with 9
+// clocks per byte (8 bits and ack), a start and address byte per
+// message and a stop per transaction, the syscall cost isn't counted.
+
+#include "ss_oled.h"
+#include "oled_emu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct bench_case
+{
+    const char *name;
+    bool deferred;
+    void (*run)(SSOLED *oled, uint8_t *buffer);
+
+} BenchCase;
+
+static uint8_t _pattern[1024];
+static uint8_t _bmp[62 + 1024];
+static uint8_t _sprite[32 * 4 + 1]; // the sprite code reads one byte ahead
+static const uint8_t _tile[32] =
+{
+    0xff,0xff,0x80,0x01,0xbf,0xfd,0xa0,0x05,0xaf,0xf5,0xa8,0x15,0xab,0xd5,0xaa,0x55,
+    0xaa,0x55,0xab,0xd5,0xa8,0x15,0xaf,0xf5,0xa0,0x05,0xbf,0xfd,0x80,0x01,0xff,0xff
+};
+
+static void _put_le(uint8_t *p, uint32_t value, int len)
+{
+    for (int i = 0; i < len; ++i)
+        p[i] = (value >> (i * 8)) & 0xff;
+}
+
+static void _bench_data_init()
+{
+    for (int i = 0; i < 1024; ++i)
+        _pattern[i] = (i * 37) ^ (i >> 3);
+
+    for (int i = 0; i < (int) sizeof(_sprite); ++i)
+        _sprite[i] = 0x5a ^ i;
+
+    // 128x64 1-bpp bitmap, bottom-up
+    memset(_bmp, 0, sizeof(_bmp));
+    _bmp[0] = 'B';
+    _bmp[1] = 'M';
+    _put_le(&_bmp[2], sizeof(_bmp), 4);
+    _put_le(&_bmp[10], 62, 4);
+    _put_le(&_bmp[14], 40, 4);
+    _put_le(&_bmp[18], 128, 4);
+    _put_le(&_bmp[22], 64, 4);
+    _put_le(&_bmp[26], 1, 2);
+    _put_le(&_bmp[28], 1, 2);
+    _put_le(&_bmp[58], 0x00ffffff, 4);
+
+    for (int i = 0; i < 1024; ++i)
+        _bmp[62 + i] = (i & 16) ? 0xaa : 0x33;
+}
+
+// primitives -----------------------------------------------------------------
+
+static void _run_fill(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_fill(oled, 0x55, 1);
+}
+
+static void _run_contrast(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_set_contrast(oled, 0x80);
+}
+
+static void _run_string_6x8(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_string_write(oled, 0, 0, 0, "The quick brown fox j", FONT_6x8, false, true);
+}
+
+static void _run_string_8x8(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_string_write(oled, 0, 0, 1, "Hello World 1234", FONT_8x8, false, true);
+}
+
+static void _run_string_12x16(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_string_write(oled, 0, 0, 2, "Hello World", FONT_12x16, true, true);
+}
+
+static void _run_string_16x16(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_string_write(oled, 0, 0, 4, "12345678", FONT_16x16, false, true);
+}
+
+static void _run_string_16x32(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_string_write(oled, 0, 0, 2, "12:34", FONT_16x32, false, true);
+}
+
+static void _run_wrap(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_set_textwrap(oled, true);
+    oled_string_write(oled, 0, 0, 0,
+                      "A long line of text that wraps on the next rows",
+                      FONT_8x8, false, true);
+}
+
+static void _run_set_pixel(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+
+    for (int i = 0; i < 16; ++i)
+        oled_set_pixel(oled, i * 7, i * 3, 1, 1);
+}
+
+static void _run_draw_line(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_draw_line(oled, 0, 0, 127, 63, 1);
+}
+
+static void _run_rectangle(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_rectangle(oled, 10, 10, 40, 30, 1, 1);
+    oled_flush(oled);
+}
+
+static void _run_ellipse(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_ellipse(oled, 64, 32, 20, 12, 1, 0);
+    oled_flush(oled);
+}
+
+static void _run_tile(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_draw_tile(oled, _tile, 32, 2, ANGLE_0, false, true);
+}
+
+static void _run_gfx(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_draw_gfx(oled, _pattern, 0, 0, 16, 2, 64, 3, 128);
+}
+
+static void _run_load_bmp(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_load_bmp(oled, _bmp, false, true);
+}
+
+static void _run_dump_buffer(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_dump_buffer(oled, _pattern);
+}
+
+static void _run_dump_small_change(SSOLED *oled, uint8_t *buffer)
+{
+    uint8_t frame[1024];
+
+    memcpy(frame, buffer, sizeof(frame));
+    frame[3 * 128 + 40] ^= 0xff;
+    frame[3 * 128 + 41] ^= 0xff;
+
+    oled_dump_buffer(oled, frame);
+}
+
+static void _run_string_scaled(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_string_scaled(oled, 0, 16, "Scaled", FONT_8x8, false, 384, 384, ROT_0);
+    oled_flush(oled);
+}
+
+static void _run_scroll(SSOLED *oled, uint8_t *buffer)
+{
+    memcpy(buffer, _pattern, 1024);
+    oled_scroll_buffer(oled, 0, 127, 0, 7, true);
+    oled_flush(oled);
+}
+
+static void _run_sprite(SSOLED *oled, uint8_t *buffer)
+{
+    (void) buffer;
+    oled_draw_sprite(oled, _sprite, 32, 32, 4, 40, 20, 1);
+    oled_flush(oled);
+}
+
+static const BenchCase _cases[] =
+{
+    {"fill",            false, _run_fill},
+    {"set_contrast",    false, _run_contrast},
+    {"string 6x8",      false, _run_string_6x8},
+    {"string 8x8",      false, _run_string_8x8},
+    {"string 12x16",    false, _run_string_12x16},
+    {"string 16x16",    false, _run_string_16x16},
+    {"string 16x32",    false, _run_string_16x32},
+    {"string wrap",     false, _run_wrap},
+    {"set_pixel x16",   false, _run_set_pixel},
+    {"draw_line",       false, _run_draw_line},
+    {"draw_tile",       false, _run_tile},
+    {"draw_gfx",        false, _run_gfx},
+    {"load_bmp",        false, _run_load_bmp},
+    {"dump_buffer",     false, _run_dump_buffer},
+    {"dump 2 bytes",    false, _run_dump_small_change},
+    {"rectangle+flush", true,  _run_rectangle},
+    {"ellipse+flush",   true,  _run_ellipse},
+    {"scaled+flush",    true,  _run_string_scaled},
+    {"scroll+flush",    true,  _run_scroll},
+    {"sprite+flush",    true,  _run_sprite},
+};
+
+#define CASE_COUNT (int) (sizeof(_cases) / sizeof(_cases[0]))
+
+// i2c time estimate ----------------------------------------------------------
+
+static double _bus_time_us(const OLEDMemBus *bus, double hz)
+{
+    double clocks = 9.0 * bus->bytes        // data bytes and ack
+                    + 10.0 * bus->messages  // start and address byte
+                    + 1.0 * bus->flushes;   // stop
+
+    return clocks * 1000000.0 / hz;
+}
+
+static int _bench_type(int type, const char *name)
+{
+    int errors = 0;
+
+    printf("\n%s 128x64\n", name);
+    printf("%-16s %7s %5s %5s %9s %9s %9s  %s\n",
+           "primitive", "bytes", "msgs", "xfers",
+           "100kHz us", "400kHz us", "1MHz us", "gddram");
+
+    for (int i = 0; i < CASE_COUNT; ++i)
+    {
+        const BenchCase *bc = &_cases[i];
+
+        SSOLED oled;
+        OLEDMemBus bus;
+        OLEDEmu emu;
+        uint8_t buffer[1024];
+
+        memset(&bus, 0, sizeof(bus));
+        oled_emu_init(&emu, type, OLED_128x64, false);
+        oled_emu_attach(&emu, &bus);
+
+        if (!oled_mem_init(&oled, &bus, type, OLED_128x64, false, false))
+            return 1;
+
+        oled_set_backbuffer(&oled, buffer);
+        oled_fill(&oled, 0, 1);
+        oled_set_deferred(&oled, bc->deferred);
+
+        // only count the primitive
+        bus.bytes = 0;
+        bus.messages = 0;
+        bus.flushes = 0;
+
+        bc->run(&oled, buffer);
+
+        int diff = oled_emu_compare(&emu, buffer);
+
+        if (diff)
+            errors++;
+
+        printf("%-16s %7lu %5lu %5lu %9.0f %9.0f %9.0f  %s\n",
+               bc->name, bus.bytes, bus.messages, bus.flushes,
+               _bus_time_us(&bus, 100000.0),
+               _bus_time_us(&bus, 400000.0),
+               _bus_time_us(&bus, 1000000.0),
+               diff ? "DIFF" : "ok");
+
+        oled_close(&oled);
+    }
+
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    _bench_data_init();
+
+    int errors = 0;
+
+    errors += _bench_type(OLED_SSD1306, "SSD1306");
+    errors += _bench_type(OLED_SH1106, "SH1106");
+
+    // optional snapshot of a test screen
+    if (argc > 1)
+    {
+        SSOLED oled;
+        OLEDMemBus bus;
+        OLEDEmu emu;
+        uint8_t buffer[1024];
+
+        memset(&bus, 0, sizeof(bus));
+        oled_emu_init(&emu, OLED_SH1106, OLED_128x64, false);
+        oled_emu_attach(&emu, &bus);
+        oled_mem_init(&oled, &bus, OLED_SH1106, OLED_128x64, false, false);
+        oled_set_backbuffer(&oled, buffer);
+
+        oled_fill(&oled, 0, 1);
+        oled_string_write(&oled, 0, 0, 0, "ss_oled", FONT_16x16, false, true);
+        oled_string_write(&oled, 0, 0, 3, "controller model", FONT_6x8, false, true);
+        oled_draw_line(&oled, 0, 40, 127, 63, 1);
+        oled_close(&oled);
+
+        if (!oled_emu_save_pbm(&emu, argv[1]))
+        {
+            fprintf(stderr, "can't write %s\n", argv[1]);
+            errors++;
+        }
+    }
+
+    if (errors)
+        fprintf(stderr, "\n%d primitive(s) left the display out of sync\n", errors);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
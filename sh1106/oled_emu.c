@@ -0,0 +1,383 @@
+// oled_emu : SSD1306 / SH1106 / SH1107 controller model
+//
+// Each I2C message starts with a control byte, Co (0x80) set means
+// only the next byte follows before another control byte, D/C (0x40)
+// selects data instead of commands.
+//
+// The SSD1306 has horizontal, vertical and page addressing, the SH1106
+// and SH1107 only page addressing with the column counter stopping at
+// the last column. Commands the controller doesn't know are counted and
+// ignored as the chip would, the SH1106 ignores 0x20 for instance and
+// takes its argument as a lower column address.
+
+#include "oled_emu.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int _oled_emu_args(OLEDEmu *emu, uint8_t cmd);
+static void _oled_emu_command(OLEDEmu *emu, const uint8_t *cmd);
+static void _oled_emu_data(OLEDEmu *emu, uint8_t data);
+
+void oled_emu_init(OLEDEmu *emu, int type, int res, bool flip)
+{
+    memset(emu, 0, sizeof(OLEDEmu));
+
+    emu->type = type;
+    emu->columns = (type == OLED_SSD1306) ? 128 : 132;
+    emu->pages = (type == OLED_SH1107) ? 16 : 8;
+
+    if (type == OLED_SH1107)
+        emu->columns = 128;
+
+    // where the common modules show the controller memory,
+    // the same offsets as the library uses
+
+    emu->win_x = 0;
+    emu->win_page = 0;
+    emu->win_width = 128;
+    emu->win_pages = 8;
+
+    if (type == OLED_SH1106)
+    {
+        emu->win_x = 2;
+    }
+    else if (res == OLED_64x32)
+    {
+        emu->win_x = 32;
+        emu->win_page = flip ? 0 : 4;
+        emu->win_width = 64;
+        emu->win_pages = 4;
+    }
+    else if (res == OLED_96x16)
+    {
+        emu->win_x = flip ? 32 : 0;
+        emu->win_page = flip ? 0 : 2;
+        emu->win_width = 96;
+        emu->win_pages = 2;
+    }
+    else if (res == OLED_72x40)
+    {
+        emu->win_x = 28;
+        emu->win_page = flip ? 0 : 3;
+        emu->win_width = 72;
+        emu->win_pages = 5;
+    }
+    else if (res == OLED_128x32)
+    {
+        emu->win_pages = 4;
+    }
+    else if (res == OLED_128x128)
+    {
+        emu->win_pages = 16;
+    }
+
+    // reset state, page addressing
+    emu->mode = OLED_EMU_PAGE;
+    emu->col_end = emu->columns - 1;
+    emu->page_end = emu->pages - 1;
+    emu->contrast = 0x7f;
+}
+
+static void _oled_emu_on_write(void *user, const uint8_t *data, int len)
+{
+    oled_emu_write((OLEDEmu*) user, data, len);
+}
+
+static int _oled_emu_on_read(void *user, uint8_t *data, int len)
+{
+    return oled_emu_read((OLEDEmu*) user, data, len);
+}
+
+void oled_emu_attach(OLEDEmu *emu, OLEDMemBus *bus)
+{
+    bus->user = emu;
+    bus->on_write = _oled_emu_on_write;
+    bus->on_read = _oled_emu_on_read;
+}
+
+void oled_emu_write(OLEDEmu *emu, const uint8_t *data, int len)
+{
+    int i = 0;
+
+    while (i < len)
+    {
+        uint8_t control = data[i++];
+
+        bool single = control & 0x80;
+        bool isdata = control & 0x40;
+
+        int end = single ? i + 1 : len;
+
+        if (end > len)
+            end = len;
+
+        for ( ; i < end; ++i)
+        {
+            if (isdata)
+            {
+                _oled_emu_data(emu, data[i]);
+                continue;
+            }
+
+            if (emu->cmd_len == 0)
+                emu->cmd_need = 1 + _oled_emu_args(emu, data[i]);
+
+            emu->cmd[emu->cmd_len++] = data[i];
+
+            if (emu->cmd_len == emu->cmd_need)
+            {
+                _oled_emu_command(emu, emu->cmd);
+                emu->cmd_len = 0;
+            }
+        }
+    }
+}
+
+int oled_emu_read(OLEDEmu *emu, uint8_t *data, int len)
+{
+    // the first byte of a read is the dummy read
+
+    for (int i = 0; i < len; ++i)
+    {
+        if (i == 0)
+        {
+            data[i] = 0;
+            continue;
+        }
+
+        data[i] = emu->gddram[emu->page][emu->column];
+
+        // the column doesn't move on reads in read-modify-write mode
+        if (!emu->rmw && emu->column < emu->columns - 1)
+            emu->column++;
+    }
+
+    return len;
+}
+
+bool oled_emu_get_pixel(OLEDEmu *emu, int x, int y)
+{
+    if (x < 0 || x >= emu->win_width || y < 0 || y >= emu->win_pages * 8)
+        return false;
+
+    uint8_t b = emu->gddram[emu->win_page + (y >> 3)][emu->win_x + x];
+
+    return (b >> (y & 7)) & 1;
+}
+
+int oled_emu_compare(OLEDEmu *emu, const uint8_t *buffer)
+{
+    int diff = 0;
+    int pages = emu->win_pages;
+
+    if (pages > OLED_MAX_PAGES)
+        pages = OLED_MAX_PAGES;
+
+    for (int page = 0; page < pages; ++page)
+    {
+        for (int x = 0; x < emu->win_width; ++x)
+        {
+            if (emu->gddram[emu->win_page + page][emu->win_x + x]
+                != buffer[page * 128 + x])
+                diff++;
+        }
+    }
+
+    return diff;
+}
+
+bool oled_emu_save_pbm(OLEDEmu *emu, const char *filepath)
+{
+    FILE *file = fopen(filepath, "wb");
+
+    if (!file)
+        return false;
+
+    int width = emu->win_width;
+    int height = emu->win_pages * 8;
+
+    fprintf(file, "P4\n%d %d\n", width, height);
+
+    uint8_t row[OLED_EMU_COLUMNS / 8 + 1];
+    int pitch = (width + 7) / 8;
+
+    for (int y = 0; y < height; ++y)
+    {
+        memset(row, 0, pitch);
+
+        for (int x = 0; x < width; ++x)
+        {
+            if (oled_emu_get_pixel(emu, x, y) != emu->inverted)
+                row[x >> 3] |= 0x80 >> (x & 7);
+        }
+
+        fwrite(row, 1, pitch, file);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+static int _oled_emu_args(OLEDEmu *emu, uint8_t cmd)
+{
+    // number of argument bytes following a command
+
+    if (emu->type == OLED_SSD1306)
+    {
+        switch (cmd)
+        {
+        case 0x20:          // addressing mode
+            return 1;
+        case 0x21:          // column range
+        case 0x22:          // page range
+        case 0xa3:          // vertical scroll area
+            return 2;
+        case 0x26:          // horizontal scroll
+        case 0x27:
+            return 6;
+        case 0x29:          // vertical and horizontal scroll
+        case 0x2a:
+            return 5;
+        }
+    }
+
+    switch (cmd)
+    {
+    case 0x81:              // contrast
+    case 0x8d:              // charge pump
+    case 0xa8:              // multiplex ratio
+    case 0xad:              // dc-dc or iref
+    case 0xd3:              // display offset
+    case 0xd5:              // clock divide
+    case 0xd9:              // precharge
+    case 0xda:              // com pins
+    case 0xdb:              // vcomh
+    case 0xdc:              // start line (SH1107)
+        return 1;
+    }
+
+    return 0;
+}
+
+static void _oled_emu_command(OLEDEmu *emu, const uint8_t *cmd)
+{
+    uint8_t c = cmd[0];
+
+    emu->commands++;
+
+    if (c <= 0x0f) // lower column address
+    {
+        emu->column = (emu->column & 0xf0) | c;
+    }
+    else if (c <= 0x1f) // upper column address
+    {
+        emu->column = (emu->column & 0x0f) | ((c & 0x0f) << 4);
+    }
+    else if (c == 0x20 && emu->type == OLED_SSD1306)
+    {
+        emu->mode = cmd[1] & 3;
+
+        if (emu->mode > OLED_EMU_PAGE)
+            emu->mode = OLED_EMU_PAGE;
+    }
+    else if (c == 0x21 && emu->type == OLED_SSD1306)
+    {
+        emu->col_start = cmd[1] & 0x7f;
+        emu->col_end = cmd[2] & 0x7f;
+        emu->column = emu->col_start;
+    }
+    else if (c == 0x22 && emu->type == OLED_SSD1306)
+    {
+        emu->page_start = cmd[1] & 7;
+        emu->page_end = cmd[2] & 7;
+        emu->page = emu->page_start;
+    }
+    else if (c >= 0x40 && c <= 0x7f) // start line
+    {
+    }
+    else if (c == 0x81)
+    {
+        emu->contrast = cmd[1];
+    }
+    else if (c == 0xa0 || c == 0xa1)
+    {
+        emu->seg_remap = c & 1;
+    }
+    else if (c == 0xa6 || c == 0xa7)
+    {
+        emu->inverted = c & 1;
+    }
+    else if (c == 0xae || c == 0xaf)
+    {
+        emu->on = c & 1;
+    }
+    else if ((c & 0xf0) == 0xb0) // page address
+    {
+        emu->page = (c & 0x0f) % emu->pages;
+    }
+    else if (c == 0xc0 || c == 0xc8)
+    {
+        emu->com_reverse = (c == 0xc8);
+    }
+    else if (c == 0xe0 && emu->type != OLED_SSD1306)
+    {
+        emu->rmw = true;
+        emu->rmw_column = emu->column;
+    }
+    else if (c == 0xee && emu->type != OLED_SSD1306)
+    {
+        emu->rmw = false;
+        emu->column = emu->rmw_column;
+    }
+    else if (_oled_emu_args(emu, c) == 0 && c != 0xa4 && c != 0xa5
+             && c != 0xe3 && c != 0x2e && c != 0x2f)
+    {
+        emu->unknown++;
+    }
+}
+
+static void _oled_emu_data(OLEDEmu *emu, uint8_t data)
+{
+    if (emu->column < emu->columns)
+        emu->gddram[emu->page][emu->column] = data;
+
+    emu->data_bytes++;
+
+    if (emu->type != OLED_SSD1306)
+    {
+        // the column stops at the last one
+        if (emu->column < emu->columns - 1)
+            emu->column++;
+
+        return;
+    }
+
+    if (emu->mode == OLED_EMU_PAGE)
+    {
+        if (++emu->column > emu->col_end)
+            emu->column = emu->col_start;
+    }
+    else if (emu->mode == OLED_EMU_HORIZONTAL)
+    {
+        if (++emu->column > emu->col_end)
+        {
+            emu->column = emu->col_start;
+
+            if (++emu->page > emu->page_end)
+                emu->page = emu->page_start;
+        }
+    }
+    else // vertical
+    {
+        if (++emu->page > emu->page_end)
+        {
+            emu->page = emu->page_start;
+
+            if (++emu->column > emu->col_end)
+                emu->column = emu->col_start;
+        }
+    }
+}
+
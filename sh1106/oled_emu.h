@@ -0,0 +1,89 @@
+#ifndef __OLED_EMU_H__
+#define __OLED_EMU_H__
+
+#include "ss_oled.h"
+
+// controller model, decodes the bus stream of ss_oled into a
+// simulated display memory (GDDRAM) so what is sent can be checked
+// and measured without a panel
+
+#define OLED_EMU_PAGES 16
+#define OLED_EMU_COLUMNS 132
+
+enum
+{
+    OLED_EMU_HORIZONTAL = 0,
+    OLED_EMU_VERTICAL,
+    OLED_EMU_PAGE
+};
+
+typedef struct oled_emu
+{
+    int type;               // OLED_SSD1306, OLED_SH1106 or OLED_SH1107
+    int columns;            // controller columns
+    int pages;              // controller pages
+
+    // visible window of the panel in GDDRAM
+    int win_x;
+    int win_page;
+    int win_width;
+    int win_pages;
+
+    uint8_t gddram[OLED_EMU_PAGES][OLED_EMU_COLUMNS];
+
+    // address counter
+    int mode;
+    int column;
+    int page;
+    int col_start;
+    int col_end;
+    int page_start;
+    int page_end;
+
+    // read-modify-write, the column is restored by 0xEE
+    bool rmw;
+    int rmw_column;
+
+    // a command waiting for its arguments
+    uint8_t cmd[8];
+    int cmd_len;
+    int cmd_need;
+
+    bool on;
+    bool inverted;
+    bool seg_remap;
+    bool com_reverse;
+    uint8_t contrast;
+
+    unsigned long commands;     // decoded commands
+    unsigned long data_bytes;   // bytes written to GDDRAM
+    unsigned long unknown;      // commands the controller ignores
+
+} OLEDEmu;
+
+// reset the controller, res gives the visible window like the
+// library maps it, flip as passed to oled_init()
+void oled_emu_init(OLEDEmu *emu, int type, int res, bool flip);
+
+// decode the commands and data sent through the memory bus
+void oled_emu_attach(OLEDEmu *emu, OLEDMemBus *bus);
+
+// decode one bus message, control byte first
+void oled_emu_write(OLEDEmu *emu, const uint8_t *data, int len);
+
+// read display data, the first byte is the dummy read
+// returns the number of bytes read
+int oled_emu_read(OLEDEmu *emu, uint8_t *data, int len);
+
+// pixel of the visible window, in memory orientation
+bool oled_emu_get_pixel(OLEDEmu *emu, int x, int y);
+
+// compare the visible window with a 128 byte stride buffer,
+// returns the number of different bytes
+int oled_emu_compare(OLEDEmu *emu, const uint8_t *buffer);
+
+// save the visible window as a binary PBM, lit pixels are black
+bool oled_emu_save_pbm(OLEDEmu *emu, const char *filepath);
+
+#endif // __OLED_EMU_H__
+
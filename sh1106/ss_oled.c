@@ -19,123 +19,183 @@
 
 #include "ss_oled.h"
 #include "global.h"
+#include "font_stretched.h"
 
-#include <libi2c.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define _pgm_read_byte(x) (*(x))
-#define _pgm_read_word(x) (*(x))
+#define _pgm_read_word(x) ((x)[0] | ((x)[1] << 8))
 
 
-// initialization sequences
+// initialization sequences, sent as commands
 const unsigned char oled32_initbuf[] =
 {
-    0x00,0xae,0xd5,0x80,0xa8,0x1f,0xd3,0x00,0x40,0x8d,0x14,0xa1,0xc8,0xda,0x02,
+    0xae,0xd5,0x80,0xa8,0x1f,0xd3,0x00,0x40,0x8d,0x14,0xa1,0xc8,0xda,0x02,
     0x81,0x7f,0xd9,0xf1,0xdb,0x40,0xa4,0xa6,0xaf
 };
 
 const unsigned char oled64_initbuf[] =
 {
-    0x00,0xae,0xa8,0x3f,0xd3,0x00,0x40,0xa1,0xc8,
+    0xae,0xa8,0x3f,0xd3,0x00,0x40,0xa1,0xc8,
     0xda,0x12,0x81,0xff,0xa4,0xa6,0xd5,0x80,0x8d,0x14,
     0xaf,0x20,0x02
 };
 
 const unsigned char oled72_initbuf[] =
 {
-    0x00,0xae,0xa8,0x3f,0xd3,0x00,0x40,0xa1,0xc8,
+    0xae,0xa8,0x3f,0xd3,0x00,0x40,0xa1,0xc8,
     0xda,0x12,0x81,0xff,0xad,0x30,0xd9,0xf1,0xa4,0xa6,0xd5,0x80,0x8d,0x14,
     0xaf,0x20,0x02
 };
 
 const unsigned char oled128_initbuf[] =
 {
-    0x00, 0xae,0xdc,0x00,0x81,0x40,
+    0xae,0xdc,0x00,0x81,0x40,
     0xa1,0xc8,0xa8,0x7f,0xd5,0x50,0xd9,0x22,0xdb,0x35,0xb0,0xda,0x12,
     0xa4,0xa6,0xaf
 };
 
+static void _oled_batch_begin(SSOLED *oled);
+static void _oled_batch_end(SSOLED *oled);
+
+static void _oled_send_commands(SSOLED *oled, const uint8_t *cmd, int len);
 static void _oled_write_command(SSOLED *oled, unsigned char c);
 static void _oled_write_command2(SSOLED *oled, unsigned char c, unsigned char d);
 
 static void _oled_set_position(SSOLED *oled, int x, int y, bool render);
 static void _oled_write_datablock(SSOLED *oled, unsigned char *buffer, int len, bool render);
+static void _oled_map_position(SSOLED *oled, int *x, int *y);
+static void _oled_send_position(SSOLED *oled, int x, int y);
+static void _oled_send_data(SSOLED *oled, const uint8_t *data, int len);
+static void _oled_send_frame(SSOLED *oled, const uint8_t *frame, int pages, uint8_t fill);
 static void _invert_bytes(uint8_t *data, uint8_t len);
 
+static void _oled_present_frame(OLEDPresenter *presenter, const uint8_t *frame);
+static void* _oled_present_thread(void *arg);
+
+static void _oled_clear_dirty(SSOLED *oled);
+static void _oled_mark_dirty(SSOLED *oled, int x1, int x2, int page1, int page2);
+static void _oled_mark_span(SSOLED *oled, int offset, int len);
+
 static void _oled_write_flashblock(SSOLED *oled, uint8_t *s, int len);
 
-static void _oled_write_command(SSOLED *oled, unsigned char c)
+static void _oled_batch_begin(SSOLED *oled)
 {
-    unsigned char buf[2];
-    buf[0] = 0x00;
+    // hold back messages until the matching _oled_batch_end()
+    oled->batch++;
+}
+
+static void _oled_batch_end(SSOLED *oled)
+{
+    if (--oled->batch == 0)
+        oled->transport->flush(oled);
+}
+
+static void _oled_send_commands(SSOLED *oled, const uint8_t *cmd, int len)
+{
+    oled->transport->write_command(oled, cmd, len);
+
+    if (oled->batch == 0)
+        oled->transport->flush(oled);
+}
 
-    buf[1] = c;
-    oled_write(oled, buf, 2);
+static void _oled_write_command(SSOLED *oled, unsigned char c)
+{
+    _oled_send_commands(oled, &c, 1);
 }
 
 static void _oled_write_command2(SSOLED *oled, unsigned char c, unsigned char d)
 {
-    unsigned char buf[3];
-    buf[0] = 0x00;
+    unsigned char buf[2];
 
-    buf[1] = c;
-    buf[2] = d;
-    oled_write(oled, buf, 3);
+    buf[0] = c;
+    buf[1] = d;
+    _oled_send_commands(oled, buf, 2);
 }
 
 bool oled_init(SSOLED *oled, int channel, int addr,
                int type, int res,
                bool flip, bool invert)
+{
+    if (!oled_i2c_open(oled, channel, addr))
+        return false;
+
+    return oled_begin(oled, type, res, flip, invert);
+}
+
+bool oled_spi_init(SSOLED *oled, int channel, int cs, uint32_t speed,
+                   int gpiochip, int dc, int reset,
+                   int type, int res,
+                   bool flip, bool invert)
+{
+    if (!oled_spi_open(oled, channel, cs, speed, gpiochip, dc, reset))
+        return false;
+
+    return oled_begin(oled, type, res, flip, invert);
+}
+
+bool oled_mem_init(SSOLED *oled, OLEDMemBus *bus,
+                   int type, int res,
+                   bool flip, bool invert)
+{
+    if (!oled_mem_open(oled, bus))
+        return false;
+
+    return oled_begin(oled, type, res, flip, invert);
+}
+
+void oled_close(SSOLED *oled)
+{
+    oled->transport->flush(oled);
+    oled->transport->close(oled);
+}
+
+bool oled_begin(SSOLED *oled, int type, int res, bool flip, bool invert)
 {
     oled->buffer = NULL;
+    oled->type = type;
     oled->res = res;
     oled->flip = flip;
     oled->wrap = false;
 
-    oled->addr = addr;
+    oled->deferred = false;
+    _oled_clear_dirty(oled);
 
-    oled->file = i2c_init(channel, addr);
+    oled->batch = 0;
 
-    if (oled->file == -1)
-        return false;
+    oled->presenter = NULL;
 
     // SH1106 is 128 centered in 132
     if (type == OLED_SH1106)
         oled->res = OLED_132x64;
 
+    _oled_batch_begin(oled);
+
     if (res == OLED_128x32 || res == OLED_96x16)
-        oled_write(oled, (unsigned char*) oled32_initbuf, sizeof(oled32_initbuf));
+        _oled_send_commands(oled, oled32_initbuf, sizeof(oled32_initbuf));
     else if (res == OLED_128x128)
-        oled_write(oled, (unsigned char*) oled128_initbuf, sizeof(oled128_initbuf));
+        _oled_send_commands(oled, oled128_initbuf, sizeof(oled128_initbuf));
     else if (res == OLED_72x40)
-        oled_write(oled, (unsigned char*) oled72_initbuf, sizeof(oled72_initbuf));
+        _oled_send_commands(oled, oled72_initbuf, sizeof(oled72_initbuf));
     else // 132x64, 128x64 and 64x32
-        oled_write(oled, (unsigned char*) oled64_initbuf, sizeof(oled64_initbuf));
-    
-    unsigned char uc[4];
+        _oled_send_commands(oled, oled64_initbuf, sizeof(oled64_initbuf));
 
     if (invert)
     {
-        uc[0] = 0;
-
         // invert command
-        uc[1] = 0xa7;
-        oled_write(oled,uc, 2);
+        _oled_write_command(oled, 0xa7);
     }
 
     if (flip)
     {
-        uc[0] = 0;
-
        // rotate display 180
-        uc[1] = 0xa0;
-        oled_write(oled,uc, 2);
-
-        uc[1] = 0xc0;
-        oled_write(oled,uc, 2);
+        _oled_write_command(oled, 0xa0);
+        _oled_write_command(oled, 0xc0);
     }
 
+    _oled_batch_end(oled);
+
     if (res == OLED_96x16)
     {
         oled->oled_x = 96;
@@ -173,113 +233,538 @@ bool oled_init(SSOLED *oled, int channel, int addr,
 void oled_set_backbuffer(SSOLED *oled, uint8_t *buffer)
 {
     oled->buffer = buffer;
+
+    // the new buffer is assumed to match the display
+    _oled_clear_dirty(oled);
 }
 
-void oled_fill(SSOLED *oled, unsigned char data, int render)
+void oled_set_deferred(SSOLED *oled, bool deferred)
 {
-    unsigned char temp[16];
-    memset(temp, data, 16);
+    oled->deferred = deferred;
+}
 
-    oled->cursor_x = 0;
-    oled->cursor_y = 0;
+static inline bool _oled_is_deferred(SSOLED *oled)
+{
+    // deferred rendering needs somewhere to keep the pixels
+    return oled->deferred && oled->buffer;
+}
+
+static inline int _oled_frame_pages(SSOLED *oled)
+{
+    // pages of the display held in a frame of OLED_MAX_PAGES
+    int pages = oled->oled_y >> 3;
+
+    return (pages > OLED_MAX_PAGES) ? OLED_MAX_PAGES : pages;
+}
+
+static void _oled_clear_dirty(SSOLED *oled)
+{
+    memset(oled->dirty_min, 0xff, OLED_MAX_PAGES);
+    memset(oled->dirty_max, 0, OLED_MAX_PAGES);
+}
+
+static void _oled_mark_dirty(SSOLED *oled, int x1, int x2, int page1, int page2)
+{
+    // record a changed rectangle of the back buffer,
+    // columns x1 to x2 of pages page1 to page2
+
+    int pages = oled->oled_y >> 3;
+
+    if (pages > OLED_MAX_PAGES)
+        pages = OLED_MAX_PAGES;
+
+    if (x1 < 0)
+        x1 = 0;
+
+    if (x2 >= oled->oled_x)
+        x2 = oled->oled_x - 1;
+
+    if (page1 < 0)
+        page1 = 0;
+
+    if (page2 >= pages)
+        page2 = pages - 1;
+
+    if (x1 > x2)
+        return;
+
+    for (int page = page1; page <= page2; ++page)
+    {
+        if (x1 < oled->dirty_min[page])
+            oled->dirty_min[page] = x1;
+
+        if (x2 > oled->dirty_max[page])
+            oled->dirty_max[page] = x2;
+    }
+}
+
+static void _oled_mark_span(SSOLED *oled, int offset, int len)
+{
+    // record len bytes changed from a back buffer offset,
+    // the span may continue on the next page, the pages past the
+    // back buffer are ignored by _oled_mark_dirty()
+
+    while (len > 0)
+    {
+        int x = offset & 127;
+        int count = 128 - x;
+
+        if (count > len)
+            count = len;
+
+        _oled_mark_dirty(oled, x, x + count - 1, offset >> 7, offset >> 7);
+
+        offset = (offset + count) % (OLED_MAX_PAGES * 128);
+        len -= count;
+    }
+}
+
+int oled_flush(SSOLED *oled)
+{
+    if (oled->buffer == NULL)
+        return -1;
+
+    if (oled->presenter)
+    {
+        oled_present(oled);
+
+        return 0;
+    }
+
+    int pages = oled->oled_y >> 3;
+
+    if (pages > OLED_MAX_PAGES)
+        pages = OLED_MAX_PAGES;
+
+    int full = 0;
+
+    _oled_batch_begin(oled);
+
+    for (int page = 0; page < pages; ++page)
+    {
+        if (oled->dirty_min[page] == 0 && oled->dirty_max[page] == oled->oled_x - 1)
+            ++full;
+    }
+
+    // everything changed, send the whole frame at once
+    if (full == pages)
+    {
+        _oled_send_frame(oled, oled->buffer, pages, 0);
+        _oled_clear_dirty(oled);
+        _oled_batch_end(oled);
+
+        return 0;
+    }
+
+    for (int page = 0; page < pages; ++page)
+    {
+        if (oled->dirty_min[page] > oled->dirty_max[page])
+            continue;
+
+        int x = oled->dirty_min[page];
+        int len = oled->dirty_max[page] - x + 1;
 
-    uint8_t lines = oled->oled_y >> 3;
-    uint8_t cols = oled->oled_x >> 4;
+        _oled_send_position(oled, x, page);
+        _oled_send_data(oled, &oled->buffer[(page * 128) + x], len);
+    }
+
+    _oled_clear_dirty(oled);
+    _oled_batch_end(oled);
+
+    return 0;
+}
+
+// the middle frame holds a frame the presenter thread hasn't sent yet
+#define OLED_FRESH 4
+
+bool oled_presenter_start(SSOLED *oled, OLEDPresenter *presenter)
+{
+    if (oled->presenter)
+        return false;
+
+    const int size = OLED_MAX_PAGES * 128;
+
+    // fail before touching the presenter or the display
+    if (sem_init(&presenter->wakeup, 0, 0) != 0)
+        return false;
+
+    // what is pending in the back buffer is on the display from now on
+    if (oled->buffer)
+        oled_flush(oled);
+
+    presenter->device = *oled;
+    presenter->device.buffer = NULL;
+    presenter->device.deferred = false;
+    presenter->device.batch = 0;
+    presenter->device.tx.count = 0;
+    presenter->device.tx.size = 0;
+
+    presenter->buffer = oled->buffer;
+    presenter->deferred = oled->deferred;
+
+    if (oled->buffer)
+    {
+        memcpy(presenter->frames[0], oled->buffer, size);
+        presenter->resend = false;
+    }
+    else
+    {
+        memset(presenter->frames[0], 0, size);
+        presenter->resend = true;
+    }
+
+    memcpy(presenter->frames[1], presenter->frames[0], size);
+    memcpy(presenter->frames[2], presenter->frames[0], size);
+    memcpy(presenter->sent, presenter->frames[0], size);
+
+    presenter->back = 0;
+    presenter->middle = 1;
+    presenter->front = 2;
+    presenter->running = true;
+
+    if (pthread_create(&presenter->thread, NULL, _oled_present_thread, presenter) != 0)
+    {
+        sem_destroy(&presenter->wakeup);
+
+        return false;
+    }
+
+    oled->presenter = presenter;
+    oled->buffer = presenter->frames[presenter->back];
+    oled->deferred = true;
+    _oled_clear_dirty(oled);
+
+    return true;
+}
+
+void oled_presenter_stop(SSOLED *oled)
+{
+    OLEDPresenter *presenter = oled->presenter;
+
+    if (!presenter)
+        return;
+
+    __atomic_store_n(&presenter->running, false, __ATOMIC_RELEASE);
+    sem_post(&presenter->wakeup);
 
-    for (uint8_t y = 0; y < lines; ++y)
+    pthread_join(presenter->thread, NULL);
+    sem_destroy(&presenter->wakeup);
+
+    oled->presenter = NULL;
+    oled->buffer = presenter->buffer;
+    oled->deferred = presenter->deferred;
+
+    // the back buffer matches the display again
+    if (oled->buffer)
+        memcpy(oled->buffer, presenter->sent, OLED_MAX_PAGES * 128);
+
+    _oled_clear_dirty(oled);
+}
+
+void oled_present(SSOLED *oled)
+{
+    OLEDPresenter *presenter = oled->presenter;
+
+    if (!presenter)
     {
-        _oled_set_position(oled, 0, y, render);
+        oled_flush(oled);
+
+        return;
+    }
+
+    // publish the back frame and take whatever was in the middle,
+    // either an unsent frame which gets dropped or a sent one
+
+    int back = presenter->back;
+    int prev = __atomic_exchange_n(&presenter->middle, back | OLED_FRESH,
+                                   __ATOMIC_ACQ_REL);
 
-        // wiring library has a 32-byte buffer,
-        // so send 16 bytes so that the data prefix (0x40) can fit
-        for (uint8_t x = 0; x < cols; ++x)
+    presenter->back = prev & 3;
+
+    // keep drawing on top of the frame just presented
+    memcpy(presenter->frames[presenter->back], presenter->frames[back],
+           OLED_MAX_PAGES * 128);
+
+    oled->buffer = presenter->frames[presenter->back];
+    _oled_clear_dirty(oled);
+
+    // the thread is already due to wake up for an unsent frame
+    if (!(prev & OLED_FRESH))
+        sem_post(&presenter->wakeup);
+}
+
+static void _oled_present_frame(OLEDPresenter *presenter, const uint8_t *frame)
+{
+    // send what changed since the last frame, like oled_dump_buffer()
+
+    SSOLED *oled = &presenter->device;
+
+    int pages = oled->oled_y >> 3;
+
+    if (pages > OLED_MAX_PAGES)
+        pages = OLED_MAX_PAGES;
+
+    if (presenter->resend)
+    {
+        _oled_send_frame(oled, frame, pages, 0);
+        memcpy(presenter->sent, frame, pages * 128);
+        presenter->resend = false;
+
+        return;
+    }
+
+    _oled_batch_begin(oled);
+
+    for (int page = 0; page < pages; ++page)
+    {
+        const uint8_t *src = &frame[page * 128];
+        uint8_t *dst = &presenter->sent[page * 128];
+
+        int x1 = 0;
+        int x2 = oled->oled_x - 1;
+
+        while (x1 <= x2 && src[x1] == dst[x1])
+            x1++;
+
+        while (x2 > x1 && src[x2] == dst[x2])
+            x2--;
+
+        if (x1 > x2)
+            continue;
+
+        _oled_send_position(oled, x1, page);
+        _oled_send_data(oled, &src[x1], x2 - x1 + 1);
+
+        memcpy(&dst[x1], &src[x1], x2 - x1 + 1);
+    }
+
+    _oled_batch_end(oled);
+}
+
+static void* _oled_present_thread(void *arg)
+{
+    OLEDPresenter *presenter = (OLEDPresenter*) arg;
+
+    while (1)
+    {
+        if (sem_wait(&presenter->wakeup) != 0)
+            continue;
+
+        // read the flag first so a frame presented before stopping
+        // is always seen below
+        bool running = __atomic_load_n(&presenter->running, __ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&presenter->middle, __ATOMIC_ACQUIRE) & OLED_FRESH)
         {
-            _oled_write_datablock(oled, temp, 16, render);
+            int middle = __atomic_exchange_n(&presenter->middle, presenter->front,
+                                             __ATOMIC_ACQ_REL);
+
+            presenter->front = middle & 3;
+
+            _oled_present_frame(presenter, presenter->frames[presenter->front]);
         }
 
-        // 72 isn't evenly divisible by 16, so fix it
-        if (oled->res == OLED_72x40)
-            _oled_write_datablock(oled, temp, 8, render);
+        if (!running)
+            break;
     }
 
+    return NULL;
+}
+
+void oled_fill(SSOLED *oled, unsigned char data, int render)
+{
+    oled->cursor_x = 0;
+    oled->cursor_y = 0;
+
+    int pages = oled->oled_y >> 3;
+
+    if (pages > OLED_MAX_PAGES)
+        pages = OLED_MAX_PAGES;
+
     if (oled->buffer)
-        memset(oled->buffer, data, (oled->oled_x * oled->oled_y) / 8);
+        memset(oled->buffer, data, pages * 128);
+
+    if (render && !_oled_is_deferred(oled))
+        _oled_send_frame(oled, NULL, oled->oled_y >> 3, data);
+    else if (oled->buffer)
+        _oled_mark_dirty(oled, 0, oled->oled_x - 1, 0, pages - 1);
 }
 
 static void _oled_set_position(SSOLED *oled, int x, int y, bool render)
 {
-    // send commands to position the "cursor" (aka memory write address)
+    // position the "cursor" (aka memory write address)
     // to the given row and column
 
-    unsigned char buf[4];
-
     oled->screen_offset = (y*128) + x;
 
     if (!render)
         return;
 
+    // the pages past the back buffer are drawn directly,
+    // unless the presenter thread owns the bus
+    if (_oled_is_deferred(oled) && (y < OLED_MAX_PAGES || oled->presenter))
+        return;
+
+    _oled_send_position(oled, x, y);
+}
+
+static void _oled_map_position(SSOLED *oled, int *x, int *y)
+{
+    // translate a visible column and page to the controller's memory
+
     if (oled->res == OLED_64x32) // visible display starts at column 32, row 4
     {
-        x += 32; // display is centered in VRAM, so this is always true
+        *x += 32; // display is centered in VRAM, so this is always true
         if (oled->flip == 0) // non-flipped display starts from line 4
-            y += 4;
+            *y += 4;
     }
     else if (oled->res == OLED_132x64) // SH1106 has 128 pixels centered in 132
     {
-        x += 2;
+        *x += 2;
     }
     else if (oled->res == OLED_96x16) // visible display starts at line 2
     {
         // mapping is a bit strange on the 96x16 OLED
         if (oled->flip)
-            x += 32;
+            *x += 32;
         else
-            y += 2;
+            *y += 2;
     }
     else if (oled->res == OLED_72x40) // starts at x=28,y=3
     {
-        x += 28;
+        *x += 28;
         if (!oled->flip)
         {
-            y += 3;
+            *y += 3;
         }
     }
+}
+
+static void _oled_send_position(SSOLED *oled, int x, int y)
+{
+    // send commands to set the display memory write address
+
+    unsigned char buf[3];
 
-    buf[0] = 0x00;
+    _oled_map_position(oled, &x, &y);
 
-    buf[1] = 0xb0 | y; // set page to Y
-    buf[2] = x & 0xf; // lower column address
-    buf[3] = 0x10 | (x >> 4); // upper column addr
+    buf[0] = 0xb0 | y; // set page to Y
+    buf[1] = x & 0xf; // lower column address
+    buf[2] = 0x10 | (x >> 4); // upper column addr
 
-    oled_write(oled, buf, 4);
+    _oled_send_commands(oled, buf, 3);
 }
 
 static void _oled_write_datablock(SSOLED *oled, unsigned char *buffer, int len, bool render)
 {
     // write a block of pixel data to the OLED
-    // length can be anything from 1 to 1024 (whole display)
+    // length can be anything from 1 to 128 (one page)
 
-    unsigned char temp[129];
+    // the back buffer holds OLED_MAX_PAGES pages, what goes past
+    // it (the lower half of 128x128) can only be sent right away
+    bool past = (oled->screen_offset + len > OLED_MAX_PAGES * 128);
+    bool send = render && (!_oled_is_deferred(oled) || (past && !oled->presenter));
 
-    temp[0] = 0x40; // data command
-
-    // copying the data has the benefit in SPI mode of not letting
-    // the original data get overwritten by the SPI.transfer() function
-    if (render)
-    {
-        memcpy(&temp[1], buffer, len);
-        oled_write(oled, temp, len+1);
-    }
+    if (send)
+        _oled_send_data(oled, buffer, len);
 
     // keep a copy in local buffer
     if (oled->buffer)
     {
-        memcpy(&oled->buffer[oled->screen_offset], buffer, len);
+        if (!past)
+        {
+            // what isn't sent now is sent by oled_flush()
+            if (!send)
+                _oled_mark_span(oled, oled->screen_offset, len);
+
+            memcpy(&oled->buffer[oled->screen_offset], buffer, len);
+        }
+
         oled->screen_offset += len;
 
         // we use a fixed stride of 128 no matter what the display size
-        oled->screen_offset &= 1023;
+        oled->screen_offset &= (OLED_MAX_PAGES * 128) - 1;
+    }
+}
+
+static void _oled_send_data(SSOLED *oled, const uint8_t *data, int len)
+{
+    // send a block of pixel data to the display
+
+    // the transport copies the data into its queue
+    oled->transport->write_data(oled, data, len);
+
+    if (oled->batch == 0)
+        oled->transport->flush(oled);
+}
+
+static void _oled_send_frame(SSOLED *oled, const uint8_t *frame, int pages, uint8_t fill)
+{
+    // send the first pages of a 128 byte stride frame, or fill them
+    // with a byte pattern if frame is NULL, pages must not go past
+    // the end of the frame, the back buffer and the presenter frames
+    // hold OLED_MAX_PAGES
+
+    int width = oled->oled_x;
+
+    if (oled->type == OLED_SSD1306 && pages <= OLED_MAX_PAGES)
+    {
+        // the SSD1306 can wrap columns and pages by itself in
+        // horizontal addressing mode, so the frame goes in a single write
+
+        int x = 0;
+        int y = 0;
+
+        _oled_map_position(oled, &x, &y);
+
+        const unsigned char cmd[] =
+        {
+            0x20, 0x00,                 // horizontal addressing mode
+            0x21, x, x + width - 1,     // column range
+            0x22, y, y + pages - 1      // page range
+        };
+
+        _oled_batch_begin(oled);
+
+        _oled_send_commands(oled, cmd, sizeof(cmd));
+
+        uint8_t temp[OLED_MAX_PAGES * 128];
+
+        for (int page = 0; page < pages; ++page)
+        {
+            if (frame)
+                memcpy(&temp[page * width], &frame[page * 128], width);
+            else
+                memset(&temp[page * width], fill, width);
+        }
+
+        _oled_send_data(oled, temp, pages * width);
+
+        // back to page addressing for the other drawing functions
+        _oled_write_command2(oled, 0x20, 0x02);
+
+        _oled_batch_end(oled);
+
+        return;
     }
+
+    // the SH1106 and SH1107 only have page addressing,
+    // send one page per write
+
+    uint8_t temp[128];
+
+    if (!frame)
+        memset(temp, fill, width);
+
+    _oled_batch_begin(oled);
+
+    for (int page = 0; page < pages; ++page)
+    {
+        _oled_send_position(oled, 0, page);
+        _oled_send_data(oled, frame ? &frame[page * 128] : temp, width);
+    }
+
+    _oled_batch_end(oled);
 }
 
 void oled_power(SSOLED *oled, bool on)
@@ -314,10 +799,102 @@ void oled_set_textwrap(SSOLED *oled, int wrap)
     oled->wrap = wrap;
 }
 
-int oled_string_write(SSOLED *oled, int scroll, int x, int y,
-                      char *msg, int size, bool invert, bool render)
+static const uint8_t* _oled_glyph(int size, unsigned char c, bool invert, uint8_t *temp)
 {
-    // draw a string of small (6x8), normal (8x8) or large (16x32) characters
+    // return the columns of a character, one page after the other
+
+    switch (size)
+    {
+    case FONT_6x8:
+        temp[0] = 0; // first column is blank
+        memcpy(&temp[1], &ucSmallFont[(int) c * 5], 5);
+        if (invert)
+            _invert_bytes(temp, 6);
+        return temp;
+
+    case FONT_8x8:
+        temp[0] = 0;
+        memcpy(&temp[1], &ucFont[(int) c * 7], 7);
+        if (invert)
+            _invert_bytes(temp, 8);
+        return temp;
+
+    case FONT_16x32:
+        memcpy(temp, &ucBigFont[(int) c * 64], 64);
+        if (invert)
+            _invert_bytes(temp, 64);
+        return temp;
+
+    case FONT_12x16:
+        // the stretched glyphs are generated at build time
+        return ucFont12x16[invert ? 1 : 0][c];
+
+    default:
+        return ucFont16x16[invert ? 1 : 0][c];
+    }
+}
+
+static void _oled_write_line(SSOLED *oled, uint8_t line[][128],
+                             int x, int height, bool render)
+{
+    // send the composed columns from x to the cursor,
+    // one position and one data write per page
+
+    int len = oled->cursor_x - x;
+
+    if (len <= 0)
+        return;
+
+    for (int page = 0; page < height; ++page)
+    {
+        if (oled->cursor_y + page >= (oled->oled_y / 8))
+            break;
+
+        _oled_set_position(oled, x, oled->cursor_y + page, render);
+        _oled_write_datablock(oled, &line[page][x], len, render);
+    }
+}
+
+static int _oled_string_write(SSOLED *oled, int scroll, int x, int y,
+                              char *msg, int size, bool invert, bool render)
+{
+    // draw a string of small (6x8), normal (8x8), stretched (12x16, 16x16)
+    // or large (16x32) characters, the visible part of each text line is
+    // composed in a line buffer and sent once per page
+
+    int width;
+    int height;
+
+    switch (size)
+    {
+    case FONT_6x8:
+        width = 6;
+        height = 1;
+        break;
+
+    case FONT_8x8:
+        width = 8;
+        height = 1;
+        break;
+
+    case FONT_12x16:
+        width = 12;
+        height = 2;
+        break;
+
+    case FONT_16x16:
+        width = 16;
+        height = 2;
+        break;
+
+    case FONT_16x32:
+        width = 16;
+        height = 4;
+        break;
+
+    default:
+        return -1;
+    }
 
     if (x == -1 || y == -1)
     {
@@ -336,389 +913,74 @@ int oled_string_write(SSOLED *oled, int scroll, int x, int y,
     if ((oled->cursor_x >= oled->oled_x) || (oled->cursor_y >= (oled->oled_y / 8)))
         return -1;
 
-    _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-
-    unsigned char c;
-    unsigned char *s;
+    uint8_t line[4][128];
+    uint8_t temp[64];
 
-    unsigned char temp[40];
-    int numbytes;
-    int byte_pos;
+    int line_x = oled->cursor_x;
+    int i = 0;
 
-    // small font
-    if (size == FONT_6x8)
-    {
-        int i = 0;
-        int font_skip = scroll % 6;
+    if (scroll < 0)
+        scroll = 0;
 
-        while (msg[i] != 0
-               && oled->cursor_x < oled->oled_x
-               && oled->cursor_y < (oled->oled_y / 8))
-        {
-            // if characters are visible
-            if (scroll < 6)
-            {
-                c = msg[i] - 32;
-                byte_pos = (int) c * 5;
+    int font_skip = scroll % width;
 
-                // copy one char into the temp buffer
-                temp[0] = 0;
-                memcpy(&temp[1], &ucSmallFont[byte_pos], 5);
-
-                if (invert)
-                    _invert_bytes(temp, 6);
-
-                numbytes = 6 - font_skip;
-
-                // clip right edge
-                if (oled->cursor_x + numbytes > oled->oled_x)
-                    numbytes = oled->oled_x - oled->cursor_x;
-
-                // write character pattern
-                _oled_write_datablock(oled, &temp[font_skip], numbytes, render);
-
-                oled->cursor_x += numbytes;
-                font_skip = 0;
-
-                // word wrap enabled?
-                if (oled->wrap && oled->cursor_x >= oled->oled_x - 5)
-                {
-                    // start at the beginning of the next line
-                    oled->cursor_x = 0;
-                    oled->cursor_y++;
-
-                    _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-                }
-            }
-
-            scroll -= 6;
-            ++i;
-        }
-
-        return 0;
-    }
-
-    // normal font
-    else if (size == FONT_8x8)
+    while (msg[i] != 0
+           && oled->cursor_x < oled->oled_x
+           && oled->cursor_y + height <= (oled->oled_y / 8))
     {
-        int i = 0;
-        int font_skip = scroll & 7;
-
-        while ((msg[i] != 0)
-               && (oled->cursor_x < oled->oled_x)
-               && (oled->cursor_y < (oled->oled_y / 8)))
+        // only draw visible characters
+        if (scroll < width)
         {
-            // only display visible characters
-            if (scroll < 8)
-            {
-                c = msg[i] - 32;
-                byte_pos = (int) c * 7;
-
-                // copy one char into the temp buffer
-                temp[0] = 0;
-                memcpy(&temp[1], &ucFont[byte_pos], 7);
+            const uint8_t *glyph = _oled_glyph(size, msg[i] - 32, invert, temp);
 
-                if (invert)
-                    _invert_bytes(temp, 8);
+            int numbytes = width - font_skip;
 
-                numbytes = 8 - font_skip;
+            // clip right edge
+            if (oled->cursor_x + numbytes > oled->oled_x)
+                numbytes = oled->oled_x - oled->cursor_x;
 
-                // clip right edge
-                if (oled->cursor_x + numbytes > oled->oled_x)
-                    numbytes = oled->oled_x - oled->cursor_x;
-
-                // write character pattern
-                _oled_write_datablock(oled, &temp[font_skip], numbytes, render);
-
-                oled->cursor_x += numbytes;
-
-                // word wrap ?
-                if (oled->wrap && oled->cursor_x >= (oled->oled_x - 7))
-                {
-                    // start at the beginning of the next line
-                    oled->cursor_x = 0;
-                    oled->cursor_y++;
-
-                    _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-                }
-
-                font_skip = 0;
+            for (int page = 0; page < height; ++page)
+            {
+                memcpy(&line[page][oled->cursor_x],
+                       &glyph[(page * width) + font_skip], numbytes);
             }
 
-            scroll -= 8;
-
-            ++i;
-        }
-
-        return 0;
-    }
+            oled->cursor_x += numbytes;
+            font_skip = 0;
 
-    // big font
-    else if (size == FONT_16x32)
-    {
-        int i = 0;
-        int font_skip = scroll & 15;
-
-        while (msg[i] != 0
-               && oled->cursor_x < oled->oled_x
-               && oled->cursor_y < (oled->oled_y / 8) - 3)
-        {
-            // if characters are visible
-            if (scroll < 16)
+            // word wrap enabled?
+            if (oled->wrap && oled->cursor_x >= oled->oled_x - (width - 1))
             {
-                s = (unsigned char*) &ucBigFont[(unsigned char) (msg[i] - 32) * 64];
-
-                numbytes = 16 - font_skip;
-
-                // clip right edge
-                if (oled->cursor_x + numbytes > oled->oled_x)
-                    numbytes = oled->oled_x - oled->cursor_x;
-
-                // write 16 bytes
-                _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-                memcpy(temp, s, 16);
-
-                if (invert)
-                    _invert_bytes(temp, 16);
-
-                _oled_write_datablock(oled, &temp[font_skip], numbytes, render);
-
-                // write 16 bytes
-                _oled_set_position(oled, oled->cursor_x, oled->cursor_y + 1, render);
-                memcpy(temp, s + 16, 16);
-
-                if (invert)
-                    _invert_bytes(temp, 16);
-
-                _oled_write_datablock(oled, &temp[font_skip], numbytes, render);
-
-                // write 16 bytes
-                if (oled->cursor_y <= 5)
-                {
-                    _oled_set_position(oled, oled->cursor_x, oled->cursor_y + 2, render);
-                    memcpy(temp, s + 32, 16);
-
-                    if (invert)
-                        _invert_bytes(temp, 16);
-
-                    _oled_write_datablock(oled, &temp[font_skip], numbytes, render);
-                }
-
-                // write 16 bytes
-                if (oled->cursor_y <= 4)
-                {
-                    _oled_set_position(oled, oled->cursor_x, oled->cursor_y + 3, render);
-                    memcpy(temp, s + 48, 16);
-
-                    if (invert)
-                        _invert_bytes(temp, 16);
+                _oled_write_line(oled, line, line_x, height, render);
 
-                    _oled_write_datablock(oled, &temp[font_skip], numbytes, render);
-                }
-
-                oled->cursor_x += numbytes;
-
-                // word wrap enabled?
-                if (oled->cursor_x >= oled->oled_x-15 && oled->wrap)
-                {
-                    // start at the beginning of the next line
-                    oled->cursor_x = 0;
-                    oled->cursor_y += 4;
-                }
-
-                font_skip = 0;
+                // start at the beginning of the next line
+                oled->cursor_x = 0;
+                oled->cursor_y += height;
+                line_x = 0;
             }
-
-            scroll -= 16;
-            ++i;
         }
 
-        return 0;
+        scroll -= width;
+        ++i;
     }
 
-    // 6x8 stretched to 12x16
-    else if (size == FONT_12x16)
-    {
-        int i = 0;
-        int font_skip = scroll % 12;
-
-        while (oled->cursor_x < oled->oled_x && oled->cursor_y < (oled->oled_y/8)-1 && msg[i] != 0)
-        {
-            // stretch the 'normal' font instead of using the big font
-            if (scroll < 12) // if characters are visible
-            {
-                int tx, ty;
-                c = msg[i] - 32;
-                unsigned char uc1, uc2, ucMask, *pDest;
-                s = (unsigned char *)&ucSmallFont[(int)c*5];
-                temp[0] = 0; // first column is blank
-                memcpy(&temp[1], s, 6);
-                if (invert)
-                    _invert_bytes(temp, 6);
-                // Stretch the font to double width + double height
-                memset(&temp[6], 0, 24); // write 24 new bytes
-                for (tx=0; tx<6; tx++)
-                {
-                    ucMask = 3;
-                    pDest = &temp[6+tx*2];
-                    uc1 = uc2 = 0;
-                    c = temp[tx];
-                    for (ty=0; ty<4; ty++)
-                    {
-                        if (c & (1 << ty)) // a bit is set
-                            uc1 |= ucMask;
-                        if (c & (1 << (ty + 4)))
-                            uc2 |= ucMask;
-                        ucMask <<= 2;
-                    }
-                    pDest[0] = uc1;
-                    pDest[1] = uc1; // double width
-                    pDest[12] = uc2;
-                    pDest[13] = uc2;
-                }
-                // smooth the diagonal lines
-                for (tx=0; tx<5; tx++)
-                {
-                    uint8_t c0, c1, ucMask2;
-                    c0 = temp[tx];
-                    c1 = temp[tx+1];
-                    pDest = &temp[6+tx*2];
-                    ucMask = 1;
-                    ucMask2 = 2;
-                    for (ty=0; ty<7; ty++)
-                    {
-                        if (((c0 & ucMask) && !(c1 & ucMask) && !(c0 & ucMask2) && (c1 & ucMask2)) || (!(c0 & ucMask) && (c1 & ucMask) && (c0 & ucMask2) && !(c1 & ucMask2)))
-                        {
-                            if (ty < 3) // top half
-                            {
-                                pDest[1] |= (1 << ((ty * 2)+1));
-                                pDest[2] |= (1 << ((ty * 2)+1));
-                                pDest[1] |= (1 << ((ty+1) * 2));
-                                pDest[2] |= (1 << ((ty+1) * 2));
-                            }
-                            else if (ty == 3) // on the border
-                            {
-                                pDest[1] |= 0x80; pDest[2] |= 0x80;
-                                pDest[13] |= 1; pDest[14] |= 1;
-                            }
-                            else // bottom half
-                            {
-                                pDest[13] |= (1 << (2*(ty-4)+1));
-                                pDest[14] |= (1 << (2*(ty-4)+1));
-                                pDest[13] |= (1 << ((ty-3) * 2));
-                                pDest[14] |= (1 << ((ty-3) * 2));
-                            }
-                        }
-                        else if (!(c0 & ucMask) && (c1 & ucMask) && (c0 & ucMask2) && !(c1 & ucMask2))
-                        {
-                            if (ty < 4) // top half
-                            {
-                                pDest[1] |= (1 << ((ty * 2)+1));
-                                pDest[2] |= (1 << ((ty+1) * 2));
-                            }
-                            else
-                            {
-                                pDest[13] |= (1 << (2*(ty-4)+1));
-                                pDest[14] |= (1 << ((ty-3) * 2));
-                            }
-                        }
-                        ucMask <<= 1; ucMask2 <<= 1;
-                    }
-                }
-                numbytes = 12 - font_skip;
-                if (oled->cursor_x + numbytes > oled->oled_x) // clip right edge
-                    numbytes = oled->oled_x - oled->cursor_x;
-                _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-                _oled_write_datablock(oled, &temp[6+font_skip], numbytes, render);
-                _oled_set_position(oled, oled->cursor_x, oled->cursor_y+1, render);
-                _oled_write_datablock(oled, &temp[18+font_skip], numbytes, render);
-                oled->cursor_x += numbytes;
-                if (oled->cursor_x >= oled->oled_x-11 && oled->wrap) // word wrap enabled?
-                {
-                    oled->cursor_x = 0; // start at the beginning of the next line
-                    oled->cursor_y += 2;
-                    _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-                }
-                font_skip = 0;
-            }
-            // if characters are visible
-
-            scroll -= 12;
+    _oled_write_line(oled, line, line_x, height, render);
 
-            ++i;
-        }
-
-        return 0;
-    }
+    return 0;
+}
 
-    // 8x8 stretched to 16x16
-    else if (size == FONT_16x16)
-    {
-        int i = 0;
-        int font_skip = scroll & 15;
+int oled_string_write(SSOLED *oled, int scroll, int x, int y,
+                      char *msg, int size, bool invert, bool render)
+{
+    // the whole string goes out in one bus transaction
 
-        while (oled->cursor_x < oled->oled_x
-               && oled->cursor_y < ((oled->oled_y / 8) - 1)
-               && msg[i] != 0)
-        {
-            // stretch the 'normal' font instead of using the big font
-            if (scroll < 16)
-            // if characters are visible
-            {
-                int tx, ty;
-                c = msg[i] - 32;
-                unsigned char uc1, uc2, ucMask, *pDest;
-                s = (unsigned char *)&ucFont[(int)c*7];
-                temp[0] = 0;
-                memcpy(&temp[1], s, 7);
-                if (invert)
-                    _invert_bytes(temp, 8);
-                // Stretch the font to double width + double height
-                memset(&temp[8], 0, 32); // write 32 new bytes
-                for (tx=0; tx<8; tx++)
-                {
-                    ucMask = 3;
-                    pDest = &temp[8+tx*2];
-                    uc1 = uc2 = 0;
-                    c = temp[tx];
-                    for (ty=0; ty<4; ty++)
-                    {
-                        if (c & (1 << ty)) // a bit is set
-                            uc1 |= ucMask;
-                        if (c & (1 << (ty + 4)))
-                            uc2 |= ucMask;
-                        ucMask <<= 2;
-                    }
-                    pDest[0] = uc1;
-                    pDest[1] = uc1; // double width
-                    pDest[16] = uc2;
-                    pDest[17] = uc2;
-                }
-                numbytes = 16 - font_skip;
-                if (oled->cursor_x + numbytes > oled->oled_x) // clip right edge
-                    numbytes = oled->oled_x - oled->cursor_x;
-                _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-                _oled_write_datablock(oled, &temp[8+font_skip], numbytes, render);
-                _oled_set_position(oled, oled->cursor_x, oled->cursor_y+1, render);
-                _oled_write_datablock(oled, &temp[24+font_skip], numbytes, render);
-                oled->cursor_x += numbytes;
-                if (oled->cursor_x >= oled->oled_x-15 && oled->wrap) // word wrap enabled?
-                {
-                    oled->cursor_x = 0; // start at the beginning of the next line
-                    oled->cursor_y += 2;
-                    _oled_set_position(oled, oled->cursor_x, oled->cursor_y, render);
-                }
-                font_skip = 0;
-            }
+    _oled_batch_begin(oled);
 
-            scroll -= 16;
-            ++i;
-        }
+    int ret = _oled_string_write(oled, scroll, x, y, msg, size, invert, render);
 
-        return 0;
-    }
+    _oled_batch_end(oled);
 
-    return -1;
+    return ret;
 }
 
 static void _invert_bytes(uint8_t *data, uint8_t len)
@@ -754,6 +1016,8 @@ int oled_scroll_buffer(SSOLED *oled,
         || (end_row > 7) || (start_row > end_row))
         return -1;
 
+    _oled_mark_dirty(oled, start_col, end_col, start_row, end_row);
+
     if (dir_up)
     {
         for (row = start_row; row <= end_row; ++row)
@@ -864,6 +1128,7 @@ int iWidthMask, iWidthShift;
 
   s = (uint8_t *)pCurrent; // start of animation data
   i = 0;
+  _oled_batch_begin(pOLED);
   _oled_set_position(pOLED, 0,0,1);
   while (i < iBufferSize) // run one frame
   {
@@ -937,6 +1202,7 @@ int iWidthMask, iWidthShift;
        break;  
     } // switch on code type
   } // while rendering a frame
+  _oled_batch_end(pOLED);
   if (s >= pAnimation + iLen) // we've hit the end, restart from the beginning
      s = pAnimation;
   return s; // return pointer to start of next frame
@@ -1018,6 +1284,9 @@ void oled_draw_sprite(SSOLED *pOLED, uint8_t *pSprite, int cx, int cy, int iPitc
     }
     if (x + cx > pOLED->oled_x)
         cx = pOLED->oled_x - x;
+    if (cx <= 0 || cy <= 0)
+        return; // nothing visible
+    _oled_mark_dirty(pOLED, dx, dx + cx - 1, dy >> 3, (dy + cy - 1) >> 3);
     for (ty=0; ty<cy; ty++)
     {
         s = &pSprite[iStartX >> 3];
@@ -1154,10 +1423,12 @@ void oled_draw_tile(SSOLED *pOLED, const uint8_t *pTile, int x, int y, int iRota
         _invert_bytes(ucTemp, 32);
 
     // Send the data to the display
+    _oled_batch_begin(pOLED);
     _oled_set_position(pOLED, x, y, bRender);
     _oled_write_datablock(pOLED, ucTemp, 16, bRender); // top half
     _oled_set_position(pOLED, x,y+1, bRender);
     _oled_write_datablock(pOLED, &ucTemp[16], 16, bRender); // bottom half
+    _oled_batch_end(pOLED);
 }
 
 
@@ -1176,17 +1447,16 @@ unsigned char uc, ucOld;
 
   if (pOLED->buffer)
     uc = ucOld = pOLED->buffer[i];
-  else if (pOLED->res == OLED_132x64 || pOLED->res == OLED_128x128) // SH1106/SH1107 can read data
+  else if ((pOLED->res == OLED_132x64 || pOLED->res == OLED_128x128)
+           && pOLED->transport->read) // SH1106/SH1107 can read data
   {
-    uint8_t ucTemp[3];
-     ucTemp[0] = 0x80; // one command
-     ucTemp[1] = 0xE0; // read_modify_write
-     ucTemp[2] = 0xC0; // one data
-     oled_write(pOLED, ucTemp, 3);
+    uint8_t ucTemp[2];
+     _oled_write_command(pOLED, 0xE0); // read_modify_write
+     pOLED->transport->flush(pOLED); // the command must be out before reading
 
      // read a dummy byte followed by the data byte we want
-     //i2c_read(pOLED->file, pOLED->addr, ucTemp, 2);
-     read(pOLED->file, ucTemp, 2);
+     if (pOLED->transport->read(pOLED, ucTemp, 2) != 2)
+        ucTemp[1] = 0;
 
      uc = ucOld = ucTemp[1]; // first byte is garbage 
   }
@@ -1206,14 +1476,13 @@ unsigned char uc, ucOld;
       _oled_write_datablock(pOLED, &uc, 1, bRender);
       pOLED->buffer[i] = uc;
     }
-    else if (pOLED->res == OLED_132x64 || pOLED->res == OLED_128x128) // end the read_modify_write operation
-    {
-      uint8_t ucTemp[4];
-      ucTemp[0] = 0xc0; // one data
-      ucTemp[1] = uc;   // actual data
-      ucTemp[2] = 0x80; // one command
-      ucTemp[3] = 0xEE; // end read_modify_write operation
-      oled_write(pOLED, ucTemp, 4);
+    else if ((pOLED->res == OLED_132x64 || pOLED->res == OLED_128x128)
+             && pOLED->transport->read) // end the read_modify_write operation
+    {
+      _oled_batch_begin(pOLED);
+      _oled_send_data(pOLED, &uc, 1);
+      _oled_write_command(pOLED, 0xEE); // end read_modify_write operation
+      _oled_batch_end(pOLED);
     }
   }
   return 0;
@@ -1231,7 +1500,8 @@ int iOffBits, q, y, j; // offset to bitmap data
 int iPitch;
 uint8_t x, z, b, *s;
 uint8_t dst_mask;
-uint8_t ucTemp[16]; // process 16 bytes at a time
+uint8_t *ucTemp;
+uint8_t ucFrame[1024]; // the whole frame is converted first
 uint8_t bFlipped = false;
 
   i16 = _pgm_read_word(pBMP);
@@ -1256,13 +1526,13 @@ uint8_t bFlipped = false;
     iOffBits += (63 * 16); // start from bottom
   }
 
-// rotate the data and send it to the display
+// rotate the data into the frame
   for (y=0; y<8; y++) // 8 lines of 8 pixels
   {
-     _oled_set_position(pOLED, 0, y, bRender);
      for (j=0; j<8; j++) // do 8 sections of 16 columns
      {
          s = &pBMP[iOffBits + (j*2) + (y * iPitch*8)]; // source line
+         ucTemp = &ucFrame[(y * 128) + (j * 16)];
          memset(ucTemp, 0, 16); // start with all black
          for (x=0; x<16; x+=8) // do each block of 16x8 pixels
          {
@@ -1281,9 +1551,15 @@ uint8_t bFlipped = false;
             s++; // next source byte
          } // for x
          if (bInvert) _invert_bytes(ucTemp, 16);
-         _oled_write_datablock(pOLED, ucTemp, 16, bRender);
      } // for j
   } // for y
+  if (pOLED->buffer)
+     memcpy(pOLED->buffer, ucFrame, sizeof(ucFrame));
+  // and send it to the display in one go
+  if (bRender && !_oled_is_deferred(pOLED))
+     _oled_send_frame(pOLED, ucFrame, _oled_frame_pages(pOLED), 0);
+  else if (pOLED->buffer)
+     _oled_mark_dirty(pOLED, 0, 127, 0, 7);
   return 0;
 }
 
@@ -1302,6 +1578,7 @@ int oled_draw_gfx(SSOLED *pOLED, uint8_t *pBuffer, int iSrcCol, int iSrcRow, int
         || (iDestRow < 0) || (iDestRow >= (pOLED->oled_y >> 3)) || (iSrcPitch <= 0))
         return -1;
     
+    _oled_batch_begin(pOLED);
     for (y=iSrcRow; y<iSrcRow+iHeight; y++)
     {
         uint8_t *s = &pBuffer[(y * iSrcPitch)+iSrcCol];
@@ -1310,50 +1587,66 @@ int oled_draw_gfx(SSOLED *pOLED, uint8_t *pBuffer, int iSrcCol, int iSrcRow, int
         pBuffer += iSrcPitch;
         iDestRow++;
     } // for y
+    _oled_batch_end(pOLED);
     return 0;
 } /* oledDrawGFX() */
 //
 // Dump a screen's worth of data directly to the display
-// Try to speed it up by comparing the new bytes with the existing buffer
+// Try to speed it up by comparing the new bytes with the existing buffer,
+// only the changed column range of each page is sent
 //
 void oled_dump_buffer(SSOLED *pOLED, uint8_t *pBuffer)
 {
-int x, y;
-int iLines, iCols;
-uint8_t bNeedPos;
-uint8_t *pSrc = pOLED->buffer;
-    
-  if (pBuffer == NULL) // dump the internal buffer if none is given
-    pBuffer = pOLED->buffer;
-  if (pBuffer == NULL)
-    return; // no backbuffer and no provided buffer
-  
-  iLines = pOLED->oled_y >> 3;
-  iCols = pOLED->oled_x >> 4;
-  for (y=0; y<iLines; y++)
+int y, x1, x2;
+int iLines, iPages;
+uint8_t *pSrc, *pDst;
+
+  iPages = pOLED->oled_y >> 3; // pages of the display
+  iLines = _oled_frame_pages(pOLED); // pages held by the back buffer
+
+  if (pOLED->buffer == NULL) // no back buffer to compare with, send everything
   {
-    bNeedPos = 1; // start of a new line means we need to set the position too
-    for (x=0; x<iCols; x++) // wiring library has a 32-byte buffer, so send 16 bytes so that the data prefix (0x40) can fit
+    if (pBuffer == NULL)
+      return; // no backbuffer and no provided buffer
+    _oled_send_frame(pOLED, pBuffer, iPages, 0);
+    return;
+  }
+
+  _oled_batch_begin(pOLED);
+
+  if (pBuffer == NULL || pBuffer == pOLED->buffer) // dump the internal buffer
+  {
+    _oled_mark_dirty(pOLED, 0, pOLED->oled_x - 1, 0, iLines - 1);
+  }
+  else
+  {
+    for (y=0; y<iLines; y++)
     {
-      if (pOLED->buffer == NULL || pBuffer == pSrc || memcmp(pSrc, pBuffer, 16) != 0) // doesn't match, need to send it
-      {
-        if (bNeedPos) // need to reposition output cursor?
-        {
-           bNeedPos = 0;
-           _oled_set_position(pOLED, x*16, y, 1);
-        }
-        _oled_write_datablock(pOLED, pBuffer, 16, 1);
-      }
-      else
-      {
-         bNeedPos = 1; // we're skipping a block, so next time will need to set the new position
-      }
-      pSrc += 16;
-      pBuffer += 16;
-    } // for x
-    pSrc += (128 - pOLED->oled_x); // for narrow displays, skip to the next line
-    pBuffer += (128 - pOLED->oled_x);
-  } // for y
+      pSrc = &pBuffer[y * 128];
+      pDst = &pOLED->buffer[y * 128];
+      x1 = 0;
+      x2 = pOLED->oled_x - 1;
+      while (x1 <= x2 && pSrc[x1] == pDst[x1]) // find the changed range
+        x1++;
+      while (x2 > x1 && pSrc[x2] == pDst[x2])
+        x2--;
+      if (x1 > x2)
+        continue; // this page doesn't change
+      memcpy(&pDst[x1], &pSrc[x1], x2 - x1 + 1);
+      _oled_mark_dirty(pOLED, x1, x2, y, y);
+    } // for y
+    // the pages past the back buffer (128x128) have nothing to
+    // compare with, send them as they are, unless the presenter
+    // thread owns the bus
+    for (y=iLines; y<iPages && !pOLED->presenter; y++)
+    {
+      _oled_send_position(pOLED, 0, y);
+      _oled_send_data(pOLED, &pBuffer[y * 128], pOLED->oled_x);
+    } // for y
+  }
+
+  oled_flush(pOLED);
+  _oled_batch_end(pOLED);
 } /* oledDumpBuffer() */
 
 void oled_draw_line(SSOLED *pOLED, int x1, int y1, int x2, int y2, int bRender)
@@ -1369,6 +1662,8 @@ void oled_draw_line(SSOLED *pOLED, int x1, int y1, int x2, int y2, int bRender)
   if (x1 < 0 || x2 < 0 || y1 < 0 || y2 < 0 || x1 >= pOLED->oled_x || x2 >= pOLED->oled_x || y1 >= pOLED->oled_y || y2 >= pOLED->oled_y)
      return;
 
+  _oled_batch_begin(pOLED);
+
   if(abs(dx) > abs(dy)) {
     // X major case
     if(x2 < x1) {
@@ -1481,6 +1776,7 @@ void oled_draw_line(SSOLED *pOLED, int x1, int y1, int x2, int y2, int bRender)
       _oled_write_datablock(pOLED, &bNew, 1, bRender);
     }
   } // y major case
+  _oled_batch_end(pOLED);
 } /* oledDrawLine() */
 
 //
@@ -1553,6 +1849,7 @@ int iFontWidth;
                   d[0] |= (1 << (ny & 7));
                else
                   d[0] &= ~(1 << (ny & 7));
+               _oled_mark_dirty(pOLED, nx, nx, ny >> 3, ny >> 3);
             }
             row += sy; // add fractional increment to source row of character
          } // for ty
@@ -1596,6 +1893,7 @@ static void DrawScaledPixel(SSOLED *pOLED, int iCX, int iCY, int x, int y, int32
         *d |= ucMask;
     else
         *d &= ~ucMask;
+    _oled_mark_dirty(pOLED, x, x, y >> 3, y >> 3);
 } /* DrawScaledPixel() */
 //
 // For drawing filled ellipses
@@ -1614,6 +1912,9 @@ static void DrawScaledLine(SSOLED *pOLED, int iCX, int iCY, int x, int y, int32_
     if (x < 0) x = 0;
     if (x2 >= pOLED->oled_x) x2 = pOLED->oled_x-1;
     iLen = x2 - x + 1; // new length
+    if (iLen <= 0)
+        return;
+    _oled_mark_dirty(pOLED, x, x2, y >> 3, y >> 3);
     d = &pOLED->buffer[((y >> 3)*128) + x];
     ucMask = 1 << (y & 7);
     if (ucColor) // white
@@ -1721,6 +2022,7 @@ void oled_rectangle(SSOLED *pOLED, int x1, int y1, int x2, int y2, uint8_t ucCol
         y1 = y2;
         y2 = tmp;
     }
+    _oled_mark_dirty(pOLED, x1, x2, y1 >> 3, y2 >> 3);
     if (bFilled)
     {
         int x, y, iMiddle;
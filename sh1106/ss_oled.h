@@ -1,14 +1,97 @@
 #ifndef __SS_OLED_H__
 #define __SS_OLED_H__
 
+#include <pthread.h>
+#include <semaphore.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
 
+// the back buffer uses a fixed stride of 128 bytes and 8 pages,
+// deferred rendering, oled_flush() and the presenter only cover
+// these pages, the lower half of a 128x128 display is only updated
+// by oled_dump_buffer() or by drawing directly
+#define OLED_MAX_PAGES 8
+
+// bus messages are queued and sent together by the transport flush(),
+// the kernel accepts up to 42 messages per I2C_RDWR call
+#define OLED_TX_MSGS 42
+#define OLED_TX_SIZE 2048
+
+// each queued message starts with its I2C control byte, 0x00 for
+// commands and 0x40 for data, whatever the bus it goes out on
+typedef struct oled_tx
+{
+    int count;                  // queued messages
+    int size;                   // bytes used in data
+    uint16_t len[OLED_TX_MSGS];
+    uint8_t data[OLED_TX_SIZE];
+
+} OLEDTransaction;
+
+// bus statistics, latency[i] counts the flushes that took
+// from 2^i to 2^(i+1) microseconds, the last bucket takes the rest
+#define OLED_STATS_BUCKETS 20
+
+typedef struct oled_stats
+{
+    unsigned long bytes;        // bytes sent, control bytes included
+    unsigned long commands;     // command messages sent
+    unsigned long data;         // data messages sent
+    unsigned long transactions; // flushes with something to send
+    unsigned long short_writes; // transactions cut short
+    unsigned long failed;       // transactions the driver refused
+
+    uint64_t total_ns;          // time spent in the transport
+    unsigned long latency[OLED_STATS_BUCKETS];
+
+} OLEDStats;
+
+struct ssoled;
+
+// bus backend, write_command() and write_data() queue a message,
+// flush() sends what is queued, read() is NULL if the bus can't read
+typedef struct oled_transport
+{
+    bool (*write_command)(struct ssoled *oled, const uint8_t *data, int len);
+    bool (*write_data)(struct ssoled *oled, const uint8_t *data, int len);
+    int (*read)(struct ssoled *oled, uint8_t *data, int len);
+    bool (*flush)(struct ssoled *oled);
+    void (*close)(struct ssoled *oled);
+
+} OLEDTransport;
+
+// in-memory bus, messages are logged as they would appear on I2C
+// (control byte first) and can be checked by a callback
+typedef struct oled_membus
+{
+    uint8_t *data;              // log of sent bytes, may be NULL
+    size_t size;                // size of the log
+    size_t len;                 // bytes logged
+    unsigned long dropped;      // bytes that didn't fit in the log
+
+    unsigned long bytes;        // bytes sent, control bytes included
+    unsigned long messages;     // messages sent
+    unsigned long flushes;      // bus transactions
+
+    void *user;
+    void (*on_write)(void *user, const uint8_t *data, int len);
+    int (*on_read)(void *user, uint8_t *data, int len);
+
+} OLEDMemBus;
+
 typedef struct ssoled
 {
-    int file;
+    // bus backend and its state
+    const OLEDTransport *transport;
+    int file;                   // i2c-dev or spidev device
+    int gpio;                   // spi DC and RESET lines request
     uint8_t addr;
+    OLEDMemBus *membus;
+    OLEDStats *stats;           // NULL when not counting
+
+    uint8_t type;
     uint8_t flip;
     uint8_t res;
     bool wrap;
@@ -21,8 +104,43 @@ typedef struct ssoled
 
     int screen_offset;
 
+    // deferred rendering, drawing only touches the back buffer and
+    // the changed column range of each page is sent by oled_flush()
+    bool deferred;
+    uint8_t dirty_min[OLED_MAX_PAGES];
+    uint8_t dirty_max[OLED_MAX_PAGES];
+
+    // messages are only sent when the outermost batch ends
+    int batch;
+    OLEDTransaction tx;
+
+    struct oled_presenter *presenter;
+
 } SSOLED;
 
+// triple buffered presentation, the application draws into one frame,
+// the presenter thread sends another and the third one holds the
+// latest presented frame waiting to be picked up
+typedef struct oled_presenter
+{
+    uint8_t frames[3][OLED_MAX_PAGES * 128];
+    uint8_t sent[OLED_MAX_PAGES * 128];
+
+    int back;           // frame the application draws into
+    int front;          // frame the presenter thread sends
+    int middle;         // latest presented frame, shared
+    bool resend;        // the display content is unknown
+
+    SSOLED device;      // presenter thread's own view of the display
+    uint8_t *buffer;    // application back buffer to restore on stop
+    bool deferred;      // application rendering mode to restore on stop
+
+    bool running;
+    pthread_t thread;
+    sem_t wakeup;
+
+} OLEDPresenter;
+
 // 4 possible font sizes: 8x8, 16x32, 6x8, 16x16 (stretched from 8x8)
 enum
 {
@@ -84,10 +202,40 @@ bool oled_init(SSOLED *oled, int channel, int addr,
                int type, int res,
                bool flip, bool invert);
 
-inline void oled_write(SSOLED *oled, unsigned char *data, int len)
-{
-    write(oled->file, data, len);
-}
+// same on spidev /dev/spidev<channel>.<cs>, the DC and RESET lines
+// are on /dev/gpiochip<gpiochip>, pass -1 as reset if it isn't wired
+bool oled_spi_init(SSOLED *oled, int channel, int cs, uint32_t speed,
+                   int gpiochip, int dc, int reset,
+                   int type, int res,
+                   bool flip, bool invert);
+
+// same on an in-memory bus, for tests and benchmarks
+bool oled_mem_init(SSOLED *oled, OLEDMemBus *bus,
+                   int type, int res,
+                   bool flip, bool invert);
+
+// initializes the controller on a transport opened by one of the
+// oled_xxx_open() functions or set up by the caller
+bool oled_begin(SSOLED *oled, int type, int res, bool flip, bool invert);
+
+// close the bus, stop the presenter first if it's running
+void oled_close(SSOLED *oled);
+
+// transports, they only open the bus and set oled->transport
+bool oled_i2c_open(SSOLED *oled, int channel, int addr);
+bool oled_spi_open(SSOLED *oled, int channel, int cs, uint32_t speed,
+                   int gpiochip, int dc, int reset);
+bool oled_mem_open(SSOLED *oled, OLEDMemBus *bus);
+
+// start counting bus statistics into stats after the init,
+// or stop with NULL, the counters are reset
+void oled_set_stats(SSOLED *oled, OLEDStats *stats);
+
+// copy the current statistics, all zero if not counting
+void oled_get_stats(SSOLED *oled, OLEDStats *stats);
+
+// reset the counters
+void oled_reset_stats(SSOLED *oled);
 
 // provide or revoke a back buffer for your OLED graphics,
 // this allows you to manage the RAM used by ss_oled on tiny
@@ -96,6 +244,36 @@ inline void oled_write(SSOLED *oled, unsigned char *data, int len)
 // large enough for your display (e.g. 128x64 needs 1K - 1024 bytes)
 void oled_set_backbuffer(SSOLED *oled, uint8_t *buffer);
 
+// turn deferred rendering on or off, in deferred mode the drawing
+// functions only update the back buffer and record the changed column
+// range of each page, nothing is sent until oled_flush() is called
+// this needs a back buffer, without one the display is drawn directly
+void oled_set_deferred(SSOLED *oled, bool deferred);
+
+// send the changed parts of the back buffer to the display,
+// one position command and one data transfer per dirty page
+// when a presenter is running this presents the frame instead
+// returns 0 for success, -1 if there is no back buffer
+int oled_flush(SSOLED *oled);
+
+// start a thread that owns the bus and sends presented frames,
+// drawing is deferred into a back buffer inside the presenter and
+// oled_present() hands it over without waiting for the bus.
+// frames presented faster than the bus can take are dropped,
+// only the latest one is sent, as a diff against the previous one.
+// the thread works on a copy of the SSOLED sharing its bus and stats,
+// while it is running only draw, present and stop with the SSOLED,
+// don't send commands (contrast, power...) nor read or reset the stats
+bool oled_presenter_start(SSOLED *oled, OLEDPresenter *presenter);
+
+// send the last presented frame, stop the thread and go back
+// to the previous back buffer and rendering mode
+void oled_presenter_stop(SSOLED *oled);
+
+// hand the current back buffer over to the presenter thread,
+// drawing continues on a copy of it
+void oled_present(SSOLED *oled);
+
 // fill the frame buffer with a byte pattern
 // e.g. all off (0x00) or all on (0xff)
 void oled_fill(SSOLED *oled, unsigned char data, int render);
@@ -127,9 +305,6 @@ void oled_set_cursor(SSOLED *oled, int x, int y);
 int oled_string_write(SSOLED *oled, int scroll, int x, int y,
                       char *msg, int size, bool invert, bool render);
 
-// Initialize an SPI version of the display
-void oled_spi_init(int iType, int iDC, int iCS, int iReset, int bFlip, int bInvert, int32_t iSpeed);
-
 // Load a 128x64 1-bpp Windows bitmap
 // Pass the pointer to the beginning of the BMP file
 // First pass version assumes a full screen bitmap
@@ -153,7 +328,9 @@ int oled_string_scaled(SSOLED *oled, int x, int y, char *szMsg, int iSize, int b
 int oled_set_pixel(SSOLED *oled, int x, int y, unsigned char ucColor, int bRender);
 
 // Dump an entire custom buffer to the display
-// useful for custom animation effects
+// useful for custom animation effects, the buffer covers the whole
+// display (2K on 128x128), the pages past the back buffer are sent
+// every time, except while a presenter is running
 void oled_dump_buffer(SSOLED *oled, uint8_t *pBuffer);
 
 // Render a window of pixels from a provided buffer or the library's internal buffer
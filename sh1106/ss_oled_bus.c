@@ -0,0 +1,559 @@
+// ss_oled bus transports
+//
+// The drawing code queues commands and data with write_command() and
+// write_data(), each message keeps its I2C control byte (0x00 or 0x40)
+// in the queue and flush() sends them the way the bus needs :
+//
+// i2c-dev : one I2C_RDWR ioctl, one i2c message per queued message.
+// spidev  : runs of commands or data go in one SPI_IOC_MESSAGE ioctl,
+//           the control byte only sets the DC line.
+// memory  : messages are logged and counted, nothing is sent.
+//
+// When statistics are on every flush records what went out and how
+// long the transport took.
+
+#include "ss_oled.h"
+
+#include <libi2c.h>
+#include <msleep.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <linux/spi/spidev.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#define OLED_CONTROL_COMMAND 0x00
+#define OLED_CONTROL_DATA 0x40
+
+// queue ----------------------------------------------------------------------
+
+static bool _oled_tx_queue(SSOLED *oled, uint8_t control,
+                           const uint8_t *data, int len)
+{
+    // queue one message, what is already queued is sent first
+    // if it doesn't fit
+
+    OLEDTransaction *tx = &oled->tx;
+
+    if (len < 1 || len + 1 > OLED_TX_SIZE)
+        return false;
+
+    if (tx->count == OLED_TX_MSGS || tx->size + len + 1 > OLED_TX_SIZE)
+        oled->transport->flush(oled);
+
+    uint8_t *dest = &tx->data[tx->size];
+
+    dest[0] = control;
+    memcpy(&dest[1], data, len);
+
+    tx->len[tx->count] = len + 1;
+    tx->count++;
+    tx->size += len + 1;
+
+    return true;
+}
+
+static bool _oled_tx_command(SSOLED *oled, const uint8_t *data, int len)
+{
+    return _oled_tx_queue(oled, OLED_CONTROL_COMMAND, data, len);
+}
+
+static bool _oled_tx_data(SSOLED *oled, const uint8_t *data, int len)
+{
+    return _oled_tx_queue(oled, OLED_CONTROL_DATA, data, len);
+}
+
+static void _oled_tx_clear(SSOLED *oled)
+{
+    oled->tx.count = 0;
+    oled->tx.size = 0;
+}
+
+// statistics -----------------------------------------------------------------
+
+static uint64_t _oled_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t _oled_stats_start(SSOLED *oled)
+{
+    return oled->stats ? _oled_time_ns() : 0;
+}
+
+static void _oled_stats_end(SSOLED *oled, uint64_t start, int sent)
+{
+    // account a flush of the queued messages, sent is the number
+    // of messages that went out or -1 if the driver failed
+
+    OLEDStats *stats = oled->stats;
+
+    if (!stats)
+        return;
+
+    uint64_t elapsed = _oled_time_ns() - start;
+
+    OLEDTransaction *tx = &oled->tx;
+    uint8_t *data = tx->data;
+
+    for (int i = 0; i < sent; ++i)
+    {
+        stats->bytes += tx->len[i];
+
+        if (data[0] == OLED_CONTROL_DATA)
+            stats->data++;
+        else
+            stats->commands++;
+
+        data += tx->len[i];
+    }
+
+    stats->transactions++;
+
+    if (sent < 0)
+        stats->failed++;
+    else if (sent < tx->count)
+        stats->short_writes++;
+
+    stats->total_ns += elapsed;
+
+    uint64_t us = elapsed / 1000;
+    int bucket = 0;
+
+    while (us > 1 && bucket < OLED_STATS_BUCKETS - 1)
+    {
+        us >>= 1;
+        bucket++;
+    }
+
+    stats->latency[bucket]++;
+}
+
+void oled_set_stats(SSOLED *oled, OLEDStats *stats)
+{
+    oled->stats = stats;
+    oled_reset_stats(oled);
+}
+
+void oled_get_stats(SSOLED *oled, OLEDStats *stats)
+{
+    if (oled->stats)
+        *stats = *oled->stats;
+    else
+        memset(stats, 0, sizeof(OLEDStats));
+}
+
+void oled_reset_stats(SSOLED *oled)
+{
+    if (oled->stats)
+        memset(oled->stats, 0, sizeof(OLEDStats));
+}
+
+// i2c-dev --------------------------------------------------------------------
+
+static bool _oled_i2c_flush(SSOLED *oled)
+{
+    // send all queued messages in a single I2C_RDWR ioctl,
+    // the kernel chains them with repeated starts
+
+    OLEDTransaction *tx = &oled->tx;
+
+    if (tx->count == 0)
+        return true;
+
+    struct i2c_msg msgs[OLED_TX_MSGS];
+    uint8_t *data = tx->data;
+
+    for (int i = 0; i < tx->count; ++i)
+    {
+        msgs[i].addr = oled->addr;
+        msgs[i].flags = 0;
+        msgs[i].len = tx->len[i];
+        msgs[i].buf = data;
+
+        data += tx->len[i];
+    }
+
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = tx->count;
+
+    uint64_t start = _oled_stats_start(oled);
+
+    // the number of messages transferred
+    int sent = ioctl(oled->file, I2C_RDWR, &rdwr);
+
+    _oled_stats_end(oled, start, sent);
+    _oled_tx_clear(oled);
+
+    return (sent == (int) rdwr.nmsgs);
+}
+
+static int _oled_i2c_read(SSOLED *oled, uint8_t *data, int len)
+{
+    // a data control byte then the read, with a repeated start
+
+    uint8_t control = OLED_CONTROL_DATA;
+
+    struct i2c_msg msgs[2];
+
+    msgs[0].addr = oled->addr;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &control;
+
+    msgs[1].addr = oled->addr;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = len;
+    msgs[1].buf = data;
+
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = msgs;
+    rdwr.nmsgs = 2;
+
+    if (ioctl(oled->file, I2C_RDWR, &rdwr) < 0)
+        return -1;
+
+    return len;
+}
+
+static void _oled_i2c_close(SSOLED *oled)
+{
+    if (oled->file != -1)
+        close(oled->file);
+
+    oled->file = -1;
+}
+
+static const OLEDTransport _oled_i2c_transport =
+{
+    _oled_tx_command,
+    _oled_tx_data,
+    _oled_i2c_read,
+    _oled_i2c_flush,
+    _oled_i2c_close
+};
+
+bool oled_i2c_open(SSOLED *oled, int channel, int addr)
+{
+    oled->transport = &_oled_i2c_transport;
+    oled->gpio = -1;
+    oled->addr = addr;
+    oled->membus = NULL;
+    oled->stats = NULL;
+    _oled_tx_clear(oled);
+
+    oled->file = i2c_init(channel, addr);
+
+    return (oled->file != -1);
+}
+
+// spidev ---------------------------------------------------------------------
+
+// line indexes in the gpio request
+#define OLED_LINE_DC 0
+#define OLED_LINE_RESET 1
+
+static bool _oled_gpio_set(SSOLED *oled, int line, int value)
+{
+    struct gpio_v2_line_values values;
+
+    values.mask = 1ULL << line;
+    values.bits = value ? values.mask : 0;
+
+    return (ioctl(oled->gpio, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) >= 0);
+}
+
+static bool _oled_spi_transfer(SSOLED *oled, struct spi_ioc_transfer *xfer,
+                               int count, bool data)
+{
+    if (count == 0)
+        return true;
+
+    if (!_oled_gpio_set(oled, OLED_LINE_DC, data))
+        return false;
+
+    int expected = 0;
+
+    for (int i = 0; i < count; ++i)
+        expected += xfer[i].len;
+
+    // the number of bytes transferred
+    return (ioctl(oled->file, SPI_IOC_MESSAGE(count), xfer) == expected);
+}
+
+static bool _oled_spi_flush(SSOLED *oled)
+{
+    // consecutive messages of the same kind are chained in one
+    // SPI_IOC_MESSAGE, chip select stays asserted between them,
+    // DC only changes between commands and data
+
+    OLEDTransaction *tx = &oled->tx;
+
+    if (tx->count == 0)
+        return true;
+
+    struct spi_ioc_transfer xfer[OLED_TX_MSGS];
+    memset(xfer, 0, sizeof(xfer));
+
+    uint8_t *data = tx->data;
+    bool kind = false;
+    bool result = true;
+    int count = 0;
+    int sent = 0;
+
+    uint64_t start = _oled_stats_start(oled);
+
+    for (int i = 0; i < tx->count; ++i)
+    {
+        bool msgkind = (data[0] == OLED_CONTROL_DATA);
+
+        if (count > 0 && msgkind != kind)
+        {
+            // stop at the first failure, the rest would land at
+            // the wrong place
+            if (!_oled_spi_transfer(oled, xfer, count, kind))
+            {
+                result = false;
+                break;
+            }
+
+            sent += count;
+            memset(xfer, 0, count * sizeof(xfer[0]));
+            count = 0;
+        }
+
+        kind = msgkind;
+
+        xfer[count].tx_buf = (unsigned long) &data[1];
+        xfer[count].len = tx->len[i] - 1;
+        count++;
+
+        data += tx->len[i];
+    }
+
+    if (result && _oled_spi_transfer(oled, xfer, count, kind))
+        sent += count;
+    else
+        result = false;
+
+    _oled_stats_end(oled, start, (sent == 0 && !result) ? -1 : sent);
+    _oled_tx_clear(oled);
+
+    return result;
+}
+
+static void _oled_spi_close(SSOLED *oled)
+{
+    if (oled->file != -1)
+        close(oled->file);
+
+    if (oled->gpio != -1)
+        close(oled->gpio);
+
+    oled->file = -1;
+    oled->gpio = -1;
+}
+
+static const OLEDTransport _oled_spi_transport =
+{
+    _oled_tx_command,
+    _oled_tx_data,
+    NULL,               // the display is write only on spi
+    _oled_spi_flush,
+    _oled_spi_close
+};
+
+static int _oled_gpio_request(int gpiochip, int dc, int reset)
+{
+    // request DC and RESET as outputs, DC low and RESET high
+
+    char filepath[32];
+    snprintf(filepath, sizeof(filepath), "/dev/gpiochip%d", gpiochip);
+
+    int chip = open(filepath, O_RDWR | O_CLOEXEC);
+
+    if (chip < 0)
+    {
+        fprintf(stderr, "Unable to open %s\n", filepath);
+        return -1;
+    }
+
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof(request));
+
+    request.offsets[OLED_LINE_DC] = dc;
+    request.num_lines = 1;
+
+    if (reset >= 0)
+    {
+        request.offsets[OLED_LINE_RESET] = reset;
+        request.num_lines = 2;
+    }
+
+    strcpy(request.consumer, "ss_oled");
+
+    request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    request.config.num_attrs = 1;
+    request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    request.config.attrs[0].attr.values = 1ULL << OLED_LINE_RESET;
+    request.config.attrs[0].mask = (1ULL << request.num_lines) - 1;
+
+    int result = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &request);
+
+    close(chip);
+
+    if (result < 0)
+    {
+        fprintf(stderr, "Unable to request gpio lines\n");
+        return -1;
+    }
+
+    return request.fd;
+}
+
+bool oled_spi_open(SSOLED *oled, int channel, int cs, uint32_t speed,
+                   int gpiochip, int dc, int reset)
+{
+    oled->transport = &_oled_spi_transport;
+    oled->addr = 0;
+    oled->membus = NULL;
+    oled->stats = NULL;
+    _oled_tx_clear(oled);
+
+    oled->gpio = -1;
+
+    char filepath[32];
+    snprintf(filepath, sizeof(filepath), "/dev/spidev%d.%d", channel, cs);
+
+    oled->file = open(filepath, O_RDWR);
+
+    if (oled->file < 0)
+    {
+        fprintf(stderr, "Unable to open %s\n", filepath);
+        oled->file = -1;
+        return false;
+    }
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+
+    if (ioctl(oled->file, SPI_IOC_WR_MODE, &mode) < 0
+        || ioctl(oled->file, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0
+        || ioctl(oled->file, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
+    {
+        fprintf(stderr, "Unable to configure %s\n", filepath);
+        _oled_spi_close(oled);
+        return false;
+    }
+
+    oled->gpio = _oled_gpio_request(gpiochip, dc, reset);
+
+    if (oled->gpio == -1)
+    {
+        _oled_spi_close(oled);
+        return false;
+    }
+
+    if (reset >= 0)
+    {
+        // pulse reset, the controller needs a few us
+        _oled_gpio_set(oled, OLED_LINE_RESET, 0);
+        msleep(10);
+        _oled_gpio_set(oled, OLED_LINE_RESET, 1);
+        msleep(10);
+    }
+
+    return true;
+}
+
+// memory ---------------------------------------------------------------------
+
+static bool _oled_mem_flush(SSOLED *oled)
+{
+    OLEDTransaction *tx = &oled->tx;
+    OLEDMemBus *bus = oled->membus;
+
+    if (tx->count == 0)
+        return true;
+
+    uint8_t *data = tx->data;
+
+    uint64_t start = _oled_stats_start(oled);
+
+    for (int i = 0; i < tx->count; ++i)
+    {
+        int len = tx->len[i];
+
+        if (bus->data && bus->len + len <= bus->size)
+        {
+            memcpy(&bus->data[bus->len], data, len);
+            bus->len += len;
+        }
+        else
+        {
+            bus->dropped += len;
+        }
+
+        bus->bytes += len;
+        bus->messages++;
+
+        if (bus->on_write)
+            bus->on_write(bus->user, data, len);
+
+        data += len;
+    }
+
+    bus->flushes++;
+
+    _oled_stats_end(oled, start, tx->count);
+    _oled_tx_clear(oled);
+
+    return true;
+}
+
+static int _oled_mem_read(SSOLED *oled, uint8_t *data, int len)
+{
+    OLEDMemBus *bus = oled->membus;
+
+    if (!bus->on_read)
+        return -1;
+
+    return bus->on_read(bus->user, data, len);
+}
+
+static void _oled_mem_close(SSOLED *oled)
+{
+    oled->membus = NULL;
+}
+
+static const OLEDTransport _oled_mem_transport =
+{
+    _oled_tx_command,
+    _oled_tx_data,
+    _oled_mem_read,
+    _oled_mem_flush,
+    _oled_mem_close
+};
+
+bool oled_mem_open(SSOLED *oled, OLEDMemBus *bus)
+{
+    oled->transport = &_oled_mem_transport;
+    oled->file = -1;
+    oled->gpio = -1;
+    oled->addr = 0;
+    oled->membus = bus;
+    oled->stats = NULL;
+    _oled_tx_clear(oled);
+
+    return (bus != NULL);
+}
+
+
@@ -9,15 +9,20 @@ PKGCONFIG += tinychip
 
 HEADERS = \
     global.h \
+    oled_emu.h \
     ss_oled.h \
 
 SOURCES = \
     0temp.c \
     main.c \
+    oled_emu.c \
     ss_oled.c \
+    ss_oled_bus.c \
 
 DISTFILES = \
+    fontgen.c \
     install.sh \
+    oled_bench.c \
     License.txt \
     meson.build \
     Readme.md \